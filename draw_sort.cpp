@@ -0,0 +1,50 @@
+#include "lib/draw_sort.h"
+#include <cstring>
+#include <utility>
+
+uint64_t DrawSort::backToFrontKey(float distanceSquared, uint32_t payload) {
+    uint32_t bits;
+    std::memcpy(&bits, &distanceSquared, sizeof(bits));
+    if (bits & 0x80000000u) {
+        bits = 0; // -0.0f and rounding noise below zero count as zero distance
+    }
+    return ((uint64_t)~bits << 32) | payload;
+}
+
+void DrawSort::radixSort(std::vector<uint64_t> &keys, std::vector<uint64_t> &scratch) {
+    size_t count = keys.size();
+    if (count < 2) {
+        return;
+    }
+    scratch.resize(count);
+
+    // All four histograms in one read of the keys
+    size_t histograms[4][256] = {};
+    for (uint64_t key : keys) {
+        for (int pass = 0; pass < 4; ++pass) {
+            ++histograms[pass][(key >> (32 + 8 * pass)) & 0xFF];
+        }
+    }
+
+    uint64_t *source = keys.data(), *destination = scratch.data();
+    for (int pass = 0; pass < 4; ++pass) {
+        size_t *histogram = histograms[pass];
+        if (histogram[(source[0] >> (32 + 8 * pass)) & 0xFF] == count) {
+            continue;
+        }
+        size_t offset = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            size_t digitCount = histogram[digit];
+            histogram[digit] = offset;
+            offset += digitCount;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t key = source[i];
+            destination[histogram[(key >> (32 + 8 * pass)) & 0xFF]++] = key;
+        }
+        std::swap(source, destination);
+    }
+    if (source != keys.data()) {
+        keys.swap(scratch);
+    }
+}
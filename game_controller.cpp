@@ -1,4 +1,5 @@
 #include "lib/game_controller.h"
+#include <cfloat>
 
 GameController::GameController(GLFWwindow *window, Camera *camera, CollectibleManager &collectibleManager, SoundManager &soundManager, Terrain *terrain, Model *player)
     : window(window), camera(camera), collectibleManager(collectibleManager), soundManager(soundManager), terrain(terrain), player(player), gameState(GameState::Initializing) {
@@ -142,23 +143,52 @@ void GameController::initGame() {
     // collectibleManager.clear();            // Clear all collectibles
     collectibleManager.setCollectibles(10); // Set the number of collectibles
 
-    terrain->loadTexture("images/grass_green.png");
-    terrain->addModel("grasstall", "models/grass_tall/grass_tall.obj");
-    terrain->generateObjects(500, "grasstall", 0.0f, 10.0f, 0.5f, 0.001f, 0.007f);
-    terrain->addModel("grass", "models/grass/grass.obj");
-    terrain->generateObjects(500, "grass", 0.0f, 10.0f, 0.5f, 0.2f, 0.5f);
-
-    terrain->addModel("fern_grass", "models/fern_grass/fern_grass.obj");
-    terrain->generateObjects(500, "fern_grass", 0.0f, 10.0f, 0.5f, 0.02f, 0.1f);
+    // Grass on low, gentle ground, grass and dirt higher up, dirt on slopes and rock on cliffs
+    std::vector<TerrainLayer> layers(4);
+    layers[0].texturePath = "images/grass_green.png";
+    layers[0].heightRange = glm::vec2(0.0f, 0.55f);
+    layers[0].slopeRange = glm::vec2(0.0f, 0.6f);
+    layers[1].texturePath = "images/grass_dirt.jpg";
+    layers[1].heightRange = glm::vec2(0.55f, 1.0f);
+    layers[1].slopeRange = glm::vec2(0.0f, 0.6f);
+    layers[2].texturePath = "images/dirt.jpg";
+    layers[2].slopeRange = glm::vec2(0.6f, 1.2f);
+    layers[3].texturePath = "images/rocky_surface.jpg";
+    layers[3].slopeRange = glm::vec2(1.2f, 100.0f);
+    if (!terrain->loadMaterial(layers)) {
+        terrain->loadTexture("images/grass_green.png");
+    }
+    // Streamed terrain: have the tiles around the start position resident before placing anything on them
+    terrain->updateStreaming(glm::vec3(128 / 2, 0.0f, 128 / 2), true);
+    // Grass blades are generated on the GPU; the grass models are only a fallback without OpenGL 4.3.
+    // Their cards are mostly soft-edged alpha, so they are drawn blended rather than alpha-tested.
+    GrassSettings grass;
+    grass.heightRange = glm::vec2(0.0f, 10.0f);
+    if (!terrain->setGrass(grass)) {
+        terrain->addModel("grasstall", "models/grass_tall/grass_tall.obj", true);
+        terrain->setObjectSway("grasstall", 0.4f);
+        terrain->generateObjects(500, "grasstall", 0.0f, 10.0f, 0.5f, 0.001f, 0.007f);
+        terrain->addModel("grass", "models/grass/grass.obj", true);
+        terrain->setObjectSway("grass", 0.4f);
+        terrain->generateObjects(500, "grass", 0.0f, 10.0f, 0.5f, 0.2f, 0.5f);
+        terrain->addModel("fern_grass", "models/fern_grass/fern_grass.obj", true);
+        terrain->setObjectSway("fern_grass", 0.3f);
+        terrain->generateObjects(500, "fern_grass", 0.0f, 10.0f, 0.5f, 0.02f, 0.1f);
+    }
     terrain->addModel("bush", "models/bush/shrub.obj");
+    terrain->setObjectSway("bush", 0.1f);
     terrain->generateObjects(100, "bush", 1.0f, 10.0f, 1.0f, 0.2f, 0.7f);
 
     terrain->addModel("rock", "models/rock_scan/rock_scan.obj");
     terrain->generateObjects(50, "rock", 2.0f, 20.0f, 1.0f, 0.5f, 1.0f);
 
     terrain->addModel("pine_tree", "models/pine_tree/pine_tree.obj");
+    terrain->setObjectLod("pine_tree", 30.0f, 60.0f);
+    terrain->setObjectSway("pine_tree", 0.03f);
     terrain->generateObjects(300, "pine_tree", 2.0f, 15.0f, 5.0f, 0.01f, 0.03f);
     terrain->addModel("tree", "models/pohon/lowpoly_tree.obj");
+    terrain->setObjectLod("tree", 30.0f, 60.0f);
+    terrain->setObjectSway("tree", 0.04f);
     terrain->generateObjects(300, "tree", 2.0f, 15.0f, 5.0f, 3.0f, 5.0f);
     cout << "Terrain objects initialized!" << endl;
 
@@ -194,7 +224,11 @@ void GameController::restartGame() {
 
     collectibleManager.setCollectibles(10); // Set the number of collectibles
 
+    // Fill in the craters dug in the last round
+    keepCollectiblesAboveGround(glm::vec2(-FLT_MAX), glm::vec2(FLT_MAX), [&]() { return terrain->resetDeformations(); });
+
     // Reset player position
+    terrain->updateStreaming(glm::vec3(128 / 2, 0.0f, 128 / 2), true);
     player->SetPosition(glm::vec3(128 / 2, terrain->getHeightAt(128 / 2, 128 / 2), 128 / 2));
 
     // enable already existing collectibles
@@ -204,4 +238,25 @@ void GameController::restartGame() {
     soundManager.changeBGM("game");
     gameState = GameState::Playing; // Set game state to Playing
     cout << "Game restarted!" << endl;
+}
+
+void GameController::keepCollectiblesAboveGround(const glm::vec2 &minXZ, const glm::vec2 &maxXZ,
+                                                 const std::function<bool()> &edit) {
+    std::vector<Collectible *> affected;
+    std::vector<float> groundBefore;
+    for (auto &collectible : collectibleManager.getCollectibles()) {
+        glm::vec3 position = collectible.getPosition();
+        if (position.x >= minXZ.x && position.x <= maxXZ.x && position.z >= minXZ.y && position.z <= maxXZ.y) {
+            affected.push_back(&collectible);
+            groundBefore.push_back(terrain->getHeightAt(position.x, position.z));
+        }
+    }
+    if (!edit()) {
+        return;
+    }
+    for (size_t i = 0; i < affected.size(); ++i) {
+        glm::vec3 position = affected[i]->getPosition();
+        position.y += terrain->getHeightAt(position.x, position.z) - groundBefore[i];
+        affected[i]->setPosition(position);
+    }
 }
\ No newline at end of file
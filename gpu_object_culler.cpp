@@ -0,0 +1,325 @@
+#include "lib/gpu_object_culler.h"
+#include "lib/frustum.h"
+#include "lib/horizon_culler.h"
+#include "lib/impostor.h"
+#include "lib/terrain.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const char *const kCullShaderPath = "shaders/object_cull.comp";
+
+GLuint compileComputeProgram(const char *path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+        return 0;
+    }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    std::string code = stream.str();
+    const char *source = code.c_str();
+
+    GLint success;
+    GLchar infoLog[1024];
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+        std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: COMPUTE\n" << infoLog << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 1024, NULL, infoLog);
+        std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM\n" << infoLog << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Storage buffers are never created empty, so every binding stays valid
+GLuint createBuffer(GLenum target, size_t size, const void *data, GLenum usage) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferData(target, std::max(size, (size_t)16), size > 0 ? data : nullptr, usage);
+    return buffer;
+}
+
+GLuint diffuseTexture(const Mesh &mesh) {
+    for (const auto &texture : mesh.textures) {
+        if (texture.type == "texture_diffuse") {
+            return texture.id;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+GpuObjectCuller::~GpuObjectCuller() {
+    release();
+    if (cullProgram != 0) {
+        glDeleteProgram(cullProgram);
+    }
+}
+
+bool GpuObjectCuller::isSupported() {
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+void GpuObjectCuller::release() {
+    GLuint buffers[] = {meshVBO, meshEBO, instanceBuffer, batchBuffer, counterBuffer, counterBaseBuffer,
+                        commandCounterBuffer, meshCommandBuffer, impostorCommandBuffer, transformOutput, impostorOutput,
+                        horizonBuffer};
+    for (GLuint buffer : buffers) {
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+    if (meshVAO != 0) {
+        glDeleteVertexArrays(1, &meshVAO);
+    }
+    meshVAO = meshVBO = meshEBO = instanceBuffer = batchBuffer = counterBuffer = counterBaseBuffer = 0;
+    commandCounterBuffer = meshCommandBuffer = impostorCommandBuffer = transformOutput = impostorOutput = 0;
+    horizonBuffer = 0;
+    instanceCount = meshCommandCount = impostorCommandCount = counterCount = 0;
+    textureRanges.clear();
+    impostorDraws.clear();
+    instanceOfObject.clear();
+}
+
+bool GpuObjectCuller::build(const Terrain &terrain) {
+    if (cullProgram == 0 && (cullProgram = compileComputeProgram(kCullShaderPath)) == 0) {
+        return false;
+    }
+    release();
+
+    std::vector<uint32_t> batchSizes(terrain.objectBatches.size(), 0);
+    for (uint16_t batch : terrain.objects.batches) {
+        ++batchSizes[batch];
+    }
+
+    // Every level of every opaque batch gets a counter and an output range sized for the
+    // whole batch; each mesh of a mesh level gets a command drawing from that range
+    struct MeshCommand {
+        GLuint texture;
+        DrawElementsIndirectCommand command;
+        uint32_t counter;
+    };
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<MeshCommand> meshCommands;
+    std::vector<DrawArraysIndirectCommand> impostorCommands;
+    std::vector<uint32_t> impostorCounters, counterBases;
+    std::vector<GpuBatch> batches(terrain.objectBatches.size());
+    uint32_t transformCount = 0, impostorCount = 0;
+
+    auto addMeshLevel = [&](const Model &model, uint32_t size) {
+        uint32_t counter = (uint32_t)counterBases.size();
+        counterBases.push_back(transformCount);
+        transformCount += size;
+        for (const Mesh &mesh : model.meshes) {
+            DrawElementsIndirectCommand command = {(GLuint)mesh.indices.size(), 0, (GLuint)indices.size(),
+                                                   (GLint)vertices.size(), counterBases[counter]};
+            meshCommands.push_back({diffuseTexture(mesh), command, counter});
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+        return counter;
+    };
+
+    for (size_t b = 0; b < terrain.objectBatches.size(); ++b) {
+        const Terrain::ObjectBatch &batch = terrain.objectBatches[b];
+        GpuBatch &gpuBatch = batches[b];
+        gpuBatch.lod = glm::vec4(0.0f, 0.0f, OBJECT_LOD_FADE, 0.0f);
+        std::fill(gpuBatch.levels, gpuBatch.levels + 4, ~0u);
+        if (batch.blended || batchSizes[b] == 0) {
+            continue; // Blended objects need sorting and stay on the CPU path
+        }
+        const Terrain::ObjectType &type = terrain.objectTypes[batch.typeId];
+        gpuBatch.levels[0] = addMeshLevel(type.models[batch.modelIndex], batchSizes[b]);
+        if (!type.hasLod) {
+            continue;
+        }
+        if (type.lod.simplifiedDistance > 0.0f) {
+            gpuBatch.lod.x = type.lod.simplifiedDistance;
+            gpuBatch.levels[1] = addMeshLevel(type.lod.simplified[batch.modelIndex], batchSizes[b]);
+        }
+        if (type.lod.impostorDistance > 0.0f) {
+            gpuBatch.lod.y = type.lod.impostorDistance;
+            gpuBatch.levels[2] = (uint32_t)counterBases.size();
+            counterBases.push_back(impostorCount);
+            impostorDraws.push_back({type.lod.impostors[batch.modelIndex].get(), (GLsizei)impostorCommands.size()});
+            impostorCommands.push_back({4, 0, 0, impostorCount});
+            impostorCounters.push_back(gpuBatch.levels[2]);
+            impostorCount += batchSizes[b];
+        }
+    }
+
+    std::vector<GpuInstance> instances;
+    instances.reserve(terrain.objects.size());
+    instanceOfObject.assign(terrain.objects.size(), ~0u);
+    for (size_t i = 0; i < terrain.objects.size(); ++i) {
+        if (batches[terrain.objects.batches[i]].levels[0] == ~0u) {
+            continue;
+        }
+        instanceOfObject[i] = (uint32_t)instances.size();
+        instances.push_back(makeInstance(terrain, i));
+    }
+
+    // Commands grouped by texture, so one multi-draw covers each texture
+    std::stable_sort(meshCommands.begin(), meshCommands.end(),
+                     [](const MeshCommand &a, const MeshCommand &b) { return a.texture < b.texture; });
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<uint32_t> commandCounters;
+    for (const auto &meshCommand : meshCommands) {
+        if (textureRanges.empty() || textureRanges.back().texture != meshCommand.texture) {
+            textureRanges.push_back({meshCommand.texture, (GLsizei)commands.size(), 0});
+        }
+        ++textureRanges.back().commandCount;
+        commands.push_back(meshCommand.command);
+        commandCounters.push_back(meshCommand.counter);
+    }
+    commandCounters.insert(commandCounters.end(), impostorCounters.begin(), impostorCounters.end());
+
+    instanceCount = (GLuint)instances.size();
+    meshCommandCount = (GLuint)commands.size();
+    impostorCommandCount = (GLuint)impostorCommands.size();
+    counterCount = (GLuint)counterBases.size();
+    if (instanceCount == 0) {
+        return true;
+    }
+
+    instanceBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER, instances.size() * sizeof(GpuInstance), instances.data(), GL_STATIC_DRAW);
+    batchBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER, batches.size() * sizeof(GpuBatch), batches.data(), GL_STATIC_DRAW);
+    counterBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER, counterBases.size() * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+    counterBaseBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER, counterBases.size() * sizeof(uint32_t), counterBases.data(), GL_STATIC_DRAW);
+    commandCounterBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER, commandCounters.size() * sizeof(uint32_t), commandCounters.data(), GL_STATIC_DRAW);
+    meshCommandBuffer = createBuffer(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_COPY);
+    impostorCommandBuffer = createBuffer(GL_DRAW_INDIRECT_BUFFER, impostorCommands.size() * sizeof(DrawArraysIndirectCommand), impostorCommands.data(), GL_DYNAMIC_COPY);
+    transformOutput = createBuffer(GL_ARRAY_BUFFER, transformCount * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+    impostorOutput = createBuffer(GL_ARRAY_BUFFER, impostorCount * sizeof(ImpostorInstance), nullptr, GL_DYNAMIC_COPY);
+    horizonBuffer = createBuffer(GL_SHADER_STORAGE_BUFFER, HORIZON_CULLER_BANDS * HORIZON_CULLER_COLUMNS * sizeof(float),
+                                 nullptr, GL_STREAM_DRAW);
+
+    // Pooled meshes, same vertex layout as Mesh, with the culled matrices as attributes 5-8
+    glGenVertexArrays(1, &meshVAO);
+    glBindVertexArray(meshVAO);
+    meshVBO = createBuffer(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
+    meshEBO = createBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, transformOutput);
+    for (int column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(5 + column);
+        glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(sizeof(glm::vec4) * column));
+        glVertexAttribDivisor(5 + column, 1);
+    }
+    glBindVertexArray(0);
+
+    std::cout << "GPU object culling: " << instanceCount << " instances, " << meshCommandCount << " mesh commands in "
+              << textureRanges.size() << " multi-draws, " << impostorCommandCount << " impostor draws" << std::endl;
+    return true;
+}
+
+GpuObjectCuller::GpuInstance GpuObjectCuller::makeInstance(const Terrain &terrain, size_t object) {
+    const Terrain::ObjectInstances &objects = terrain.objects;
+    glm::vec3 center = 0.5f * (objects.boundsMin[object] + objects.boundsMax[object]);
+    float radius = 0.5f * glm::length(objects.boundsMax[object] - objects.boundsMin[object]);
+    return {objects.transforms[object], glm::vec4(center, radius), (uint32_t)objects.batches[object],
+            objects.rotations[object], objects.scales[object], 0};
+}
+
+void GpuObjectCuller::updateInstances(const Terrain &terrain, const std::vector<uint32_t> &objectIndices) {
+    if (instanceBuffer == 0) {
+        return;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+    for (uint32_t object : objectIndices) {
+        if (object < instanceOfObject.size() && instanceOfObject[object] != ~0u) {
+            GpuInstance instance = makeInstance(terrain, object);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, (GLintptr)instanceOfObject[object] * sizeof(GpuInstance),
+                            sizeof(GpuInstance), &instance);
+        }
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuObjectCuller::render(Shader &objectShader, Shader &impostorShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition,
+                             const std::vector<float> &horizonLimits, const std::vector<float> &horizonBands) {
+    if (instanceCount == 0) {
+        return;
+    }
+
+    Frustum frustum(vp);
+    glUseProgram(cullProgram);
+    GLint bandCount = (GLint)std::min(horizonLimits.size(), (size_t)HORIZON_CULLER_BANDS);
+    if (bandCount > 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, horizonBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bandCount * HORIZON_CULLER_COLUMNS * sizeof(float), horizonBands.data());
+        glUniform1fv(glGetUniformLocation(cullProgram, "horizonLimits"), bandCount, horizonLimits.data());
+    }
+    glUniform1i(glGetUniformLocation(cullProgram, "horizonBandCount"), bandCount);
+    glUniform4fv(glGetUniformLocation(cullProgram, "frustumPlanes"), 6, &frustum.planes[0][0]);
+    glUniform3fv(glGetUniformLocation(cullProgram, "cameraPosition"), 1, &cameraPosition[0]);
+    glUniform1ui(glGetUniformLocation(cullProgram, "instanceCount"), instanceCount);
+    glUniform1ui(glGetUniformLocation(cullProgram, "meshCommandCount"), meshCommandCount);
+    glUniform1ui(glGetUniformLocation(cullProgram, "impostorCommandCount"), impostorCommandCount);
+    GLuint bindings[] = {instanceBuffer, batchBuffer, counterBuffer, counterBaseBuffer, transformOutput,
+                         impostorOutput, meshCommandBuffer, impostorCommandBuffer, commandCounterBuffer, horizonBuffer};
+    for (GLuint binding = 0; binding < sizeof(bindings) / sizeof(bindings[0]); ++binding) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, bindings[binding]);
+    }
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+    GLint passLocation = glGetUniformLocation(cullProgram, "cullPass");
+    glUniform1ui(passLocation, 0);
+    glDispatchCompute((instanceCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUniform1ui(passLocation, 1);
+    glDispatchCompute((meshCommandCount + impostorCommandCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    objectShader.use();
+    objectShader.setMat4("viewProjection", vp);
+    objectShader.setInt("texture_diffuse1", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(meshVAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, meshCommandBuffer);
+    for (const auto &range : textureRanges) {
+        glBindTexture(GL_TEXTURE_2D, range.texture);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    (void *)(range.firstCommand * sizeof(DrawElementsIndirectCommand)), range.commandCount, 0);
+    }
+    glBindVertexArray(0);
+
+    if (!impostorDraws.empty()) {
+        impostorShader.use();
+        impostorShader.setMat4("viewProjection", vp);
+        impostorShader.setVec3("cameraPosition", cameraPosition);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, impostorCommandBuffer);
+        for (const auto &draw : impostorDraws) {
+            draw.impostor->drawIndirect(impostorShader, impostorOutput, draw.command);
+        }
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
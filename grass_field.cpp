@@ -0,0 +1,110 @@
+#include "lib/grass_field.h"
+#include "lib/frustum.h"
+#include "lib/terrain.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+GrassField::GrassField(const GrassSettings &settings)
+    : settings(settings),
+      bladesPerTile((GLuint)std::max(1.0f, std::round(settings.density * GRASS_TILE_SIZE * GRASS_TILE_SIZE))) {}
+
+GrassField::~GrassField() {
+    if (vao != 0) {
+        glDeleteBuffers(1, &tileBuffer);
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteVertexArrays(1, &vao);
+    }
+}
+
+bool GrassField::isSupported() {
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+float GrassField::densityAt(float distance) const {
+    float fadeLength = std::max(settings.maxDistance - settings.fullDensityDistance, 1e-3f);
+    return glm::clamp((settings.maxDistance - distance) / fadeLength, 0.0f, 1.0f);
+}
+
+void GrassField::render(const Terrain &terrain, Shader &grassShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition,
+                        const glm::vec2 &wind) {
+    const HeightPyramid &pyramid = *terrain.heightPyramid;
+    Frustum frustum(vp);
+    float tileSize = (float)GRASS_TILE_SIZE;
+    glm::vec2 extent((float)(terrain.heightmapWidth - 1), (float)(terrain.heightmapHeight - 1));
+    // Tips lean out of their tile by up to the largest bend in grass.vs plus the sway at the
+    // peak of a gust (1.15 times the wind)
+    float reach = (GRASS_MAX_BEND + settings.sway * 1.15f * glm::length(wind)) * settings.bladeHeight;
+
+    // Tiles within reach, with blades up to the density of their nearest point
+    int tileX0 = std::max((int)std::floor((cameraPosition.x - settings.maxDistance) / tileSize), 0);
+    int tileZ0 = std::max((int)std::floor((cameraPosition.z - settings.maxDistance) / tileSize), 0);
+    int tileX1 = std::min((int)std::floor((cameraPosition.x + settings.maxDistance) / tileSize), pyramid.getCellsX(GRASS_TILE_LEVEL) - 1);
+    int tileZ1 = std::min((int)std::floor((cameraPosition.z + settings.maxDistance) / tileSize), pyramid.getCellsZ(GRASS_TILE_LEVEL) - 1);
+    tileOrigins.clear();
+    commands.clear();
+    for (int tileZ = tileZ0; tileZ <= tileZ1; ++tileZ) {
+        for (int tileX = tileX0; tileX <= tileX1; ++tileX) {
+            glm::vec2 range = pyramid.getCellRange(GRASS_TILE_LEVEL, tileX, tileZ);
+            if (range.y < settings.heightRange.x || range.x > settings.heightRange.y) {
+                continue; // Nothing grows at these heights
+            }
+            glm::vec3 boxMin(tileX * tileSize - reach, range.x, tileZ * tileSize - reach);
+            glm::vec3 boxMax(std::min((tileX + 1) * tileSize, extent.x) + reach, range.y + settings.bladeHeight,
+                             std::min((tileZ + 1) * tileSize, extent.y) + reach);
+            float keep = densityAt(glm::distance(cameraPosition, glm::clamp(cameraPosition, boxMin, boxMax)));
+            if (keep <= 0.0f || !frustum.intersectsBox(boxMin, boxMax)) {
+                continue;
+            }
+            GLuint blades = std::min((GLuint)std::ceil(keep * bladesPerTile), bladesPerTile);
+            commands.push_back({(GLuint)GRASS_BLADE_VERTICES, blades, 0, (GLuint)tileOrigins.size()});
+            tileOrigins.push_back(glm::vec2(tileX * tileSize, tileZ * tileSize));
+        }
+    }
+    if (commands.empty()) {
+        return;
+    }
+
+    if (vao == 0) {
+        // The divisor outlasts every tile's instance count, so all blades of a draw read
+        // the origin its baseInstance selects
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &tileBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, tileBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *)0);
+        glVertexAttribDivisor(0, bladesPerTile);
+    }
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, tileBuffer);
+    glBufferData(GL_ARRAY_BUFFER, tileOrigins.size() * sizeof(glm::vec2), tileOrigins.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), commands.data(), GL_STREAM_DRAW);
+
+    grassShader.use();
+    grassShader.setMat4("viewProjection", vp);
+    grassShader.setVec3("cameraPosition", cameraPosition);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, terrain.heightTextureID);
+    grassShader.setInt("heightMap", 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, terrain.normalTextureID);
+    grassShader.setInt("normalMap", 2);
+    grassShader.setVec2("heightmapSize", glm::vec2((float)terrain.heightmapWidth, (float)terrain.heightmapHeight));
+    grassShader.setVec2("terrainExtent", extent);
+    grassShader.setFloat("terrainScale", terrain.terrainScale);
+    grassShader.setFloat("tileSize", tileSize);
+    grassShader.setFloat("bladesPerTile", (float)bladesPerTile);
+    grassShader.setVec2("densityDistances", glm::vec2(settings.fullDensityDistance, settings.maxDistance));
+    grassShader.setVec2("heightRange", settings.heightRange);
+    grassShader.setFloat("maxSlope", settings.maxSlope);
+    grassShader.setVec2("bladeSize", glm::vec2(settings.bladeHeight, settings.bladeWidth));
+    grassShader.setFloat("bladeSway", settings.sway);
+
+    glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP, 0, (GLsizei)commands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
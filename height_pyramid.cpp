@@ -0,0 +1,237 @@
+#include "lib/height_pyramid.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+// Narrow [tMin, tMax] to the part of the ray above the rectangle [x0, x1] x [z0, z1]
+bool clipToRect(const glm::vec3 &origin, const glm::vec3 &direction, float x0, float x1, float z0, float z1,
+                float &tMin, float &tMax) {
+    const float low[2] = {x0, z0}, high[2] = {x1, z1};
+    const float start[2] = {origin.x, origin.z}, step[2] = {direction.x, direction.z};
+    for (int axis = 0; axis < 2; ++axis) {
+        if (step[axis] == 0.0f) {
+            if (start[axis] < low[axis] || start[axis] > high[axis]) {
+                return false;
+            }
+            continue;
+        }
+        float t0 = (low[axis] - start[axis]) / step[axis];
+        float t1 = (high[axis] - start[axis]) / step[axis];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+    }
+    return tMin <= tMax;
+}
+
+// Möller-Trumbore, two-sided; the barycentric slack keeps rays from slipping between triangles
+bool intersectTriangle(const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &a, const glm::vec3 &b,
+                       const glm::vec3 &c, float &t) {
+    const float slack = 1e-5f;
+    glm::vec3 edge1 = b - a, edge2 = c - a;
+    glm::vec3 p = glm::cross(direction, edge2);
+    float det = glm::dot(edge1, p);
+    if (std::fabs(det) < 1e-12f) {
+        return false;
+    }
+    float invDet = 1.0f / det;
+    glm::vec3 s = origin - a;
+    float u = glm::dot(s, p) * invDet;
+    if (u < -slack || u > 1.0f + slack) {
+        return false;
+    }
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = glm::dot(direction, q) * invDet;
+    if (v < -slack || u + v > 1.0f + slack) {
+        return false;
+    }
+    t = glm::dot(edge2, q) * invDet;
+    return true;
+}
+
+} // namespace
+
+HeightPyramid::HeightPyramid(const float *heights, int width, int height, float heightScale,
+                             const glm::vec2 *storedRanges)
+    : heights(heights), width(width), height(height), heightScale(heightScale) {
+    quadsX = std::max(width - 1, 0);
+    quadsZ = std::max(height - 1, 0);
+    if (quadsX == 0 || quadsZ == 0) {
+        quadsX = quadsZ = 0;
+        return;
+    }
+
+    // Level 1 straight from the samples: 3x3 per cell, clamped at the far edges. Halve
+    // until a single cell covers the map.
+    int cellsX = (quadsX + 1) / 2, cellsZ = (quadsZ + 1) / 2;
+    while (true) {
+        Level level;
+        level.cellsX = cellsX;
+        level.cellsZ = cellsZ;
+        level.range.resize((size_t)cellsX * cellsZ);
+        levels.push_back(std::move(level));
+        if (storedRanges) {
+            std::copy(storedRanges, storedRanges + levels.back().range.size(), levels.back().range.begin());
+            storedRanges += levels.back().range.size();
+        } else {
+            buildCells(levels.size() - 1, 0, 0, cellsX, cellsZ);
+        }
+        if (cellsX == 1 && cellsZ == 1) {
+            break;
+        }
+        cellsX = (cellsX + 1) / 2;
+        cellsZ = (cellsZ + 1) / 2;
+    }
+}
+
+void HeightPyramid::buildCells(size_t levelIndex, int cellX0, int cellZ0, int cellX1, int cellZ1) {
+    Level &level = levels[levelIndex];
+    for (int cz = cellZ0; cz < cellZ1; ++cz) {
+        for (int cx = cellX0; cx < cellX1; ++cx) {
+            glm::vec2 range(FLT_MAX, -FLT_MAX);
+            if (levelIndex == 0) {
+                for (int z = 2 * cz; z <= std::min(2 * cz + 2, height - 1); ++z) {
+                    for (int x = 2 * cx; x <= std::min(2 * cx + 2, width - 1); ++x) {
+                        float h = sampleAt(x, z);
+                        range = glm::vec2(std::min(range.x, h), std::max(range.y, h));
+                    }
+                }
+            } else {
+                const Level &finer = levels[levelIndex - 1];
+                for (int z = 2 * cz; z < std::min(2 * cz + 2, finer.cellsZ); ++z) {
+                    for (int x = 2 * cx; x < std::min(2 * cx + 2, finer.cellsX); ++x) {
+                        const glm::vec2 &child = finer.range[(size_t)z * finer.cellsX + x];
+                        range = glm::vec2(std::min(range.x, child.x), std::max(range.y, child.y));
+                    }
+                }
+            }
+            level.range[(size_t)cz * level.cellsX + cx] = range;
+        }
+    }
+}
+
+void HeightPyramid::update(int x0, int z0, int x1, int z1) {
+    if (levels.empty() || x0 >= x1 || z0 >= z1) {
+        return;
+    }
+    // Level 1 cell c spans samples 2c to 2c + 2, so a sample can sit in two cells
+    int cellX0 = std::max((x0 - 1) / 2, 0), cellZ0 = std::max((z0 - 1) / 2, 0);
+    int cellX1 = std::min((x1 - 1) / 2 + 1, levels[0].cellsX), cellZ1 = std::min((z1 - 1) / 2 + 1, levels[0].cellsZ);
+    for (size_t i = 0; i < levels.size(); ++i) {
+        buildCells(i, cellX0, cellZ0, cellX1, cellZ1);
+        cellX0 /= 2;
+        cellZ0 /= 2;
+        cellX1 = (cellX1 - 1) / 2 + 1;
+        cellZ1 = (cellZ1 - 1) / 2 + 1;
+    }
+}
+
+std::vector<glm::vec2> HeightPyramid::getStoredRanges() const {
+    std::vector<glm::vec2> ranges;
+    for (const auto &level : levels) {
+        ranges.insert(ranges.end(), level.range.begin(), level.range.end());
+    }
+    return ranges;
+}
+
+glm::vec2 HeightPyramid::getCellRange(int level, int cellX, int cellZ) const {
+    if (level == 0) {
+        float h00 = sampleAt(cellX, cellZ), h10 = sampleAt(cellX + 1, cellZ);
+        float h01 = sampleAt(cellX, cellZ + 1), h11 = sampleAt(cellX + 1, cellZ + 1);
+        return glm::vec2(std::min(std::min(h00, h10), std::min(h01, h11)), std::max(std::max(h00, h10), std::max(h01, h11)));
+    }
+    const Level &stored = levels[level - 1];
+    return stored.range[(size_t)cellZ * stored.cellsX + cellX];
+}
+
+bool HeightPyramid::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+                            float &hitDistance) const {
+    return cast(origin, direction, maxDistance, 0.0f, hitDistance);
+}
+
+bool HeightPyramid::sphereCast(const glm::vec3 &origin, const glm::vec3 &direction, float radius, float maxDistance,
+                               float &hitDistance) const {
+    return cast(origin, direction, maxDistance, radius, hitDistance);
+}
+
+bool HeightPyramid::cast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float lift,
+                         float &hitDistance) const {
+    if (quadsX == 0) {
+        return false;
+    }
+
+    // Cells the ray passes over, front to back; a cell is skipped when the ray stays above
+    // its maximum, so open ground is crossed a few coarse cells at a time
+    struct Visit {
+        int level, cellX, cellZ;
+        float tMin, tMax;
+    };
+    Visit stack[4 * 32];
+    int stackSize = 0;
+
+    int topLevel = (int)levels.size();
+    float tMin = 0.0f, tMax = maxDistance;
+    if (!clipToRect(origin, direction, 0.0f, (float)quadsX, 0.0f, (float)quadsZ, tMin, tMax)) {
+        return false;
+    }
+    stack[stackSize++] = {topLevel, 0, 0, tMin, tMax};
+
+    while (stackSize > 0) {
+        Visit visit = stack[--stackSize];
+        float lowestY = origin.y + direction.y * (direction.y < 0.0f ? visit.tMax : visit.tMin);
+        if (lowestY > getCellRange(visit.level, visit.cellX, visit.cellZ).y + lift) {
+            continue;
+        }
+        if (visit.level == 0) {
+            if (intersectQuad(visit.cellX, visit.cellZ, origin, direction, lift, maxDistance, hitDistance)) {
+                return true; // Cells are visited in ray order, so the first hit is the nearest
+            }
+            continue;
+        }
+
+        // Children clipped to the ray, pushed far to near so the nearest is popped first
+        Visit children[4];
+        int childCount = 0;
+        int childLevel = visit.level - 1, childSize = 1 << childLevel;
+        for (int z = 2 * visit.cellZ; z < std::min(2 * visit.cellZ + 2, getCellsZ(childLevel)); ++z) {
+            for (int x = 2 * visit.cellX; x < std::min(2 * visit.cellX + 2, getCellsX(childLevel)); ++x) {
+                float childMin = visit.tMin, childMax = visit.tMax;
+                if (clipToRect(origin, direction, (float)(x * childSize), (float)std::min((x + 1) * childSize, quadsX),
+                               (float)(z * childSize), (float)std::min((z + 1) * childSize, quadsZ), childMin, childMax)) {
+                    children[childCount++] = {childLevel, x, z, childMin, childMax};
+                }
+            }
+        }
+        std::sort(children, children + childCount, [](const Visit &a, const Visit &b) { return a.tMin > b.tMin; });
+        for (int i = 0; i < childCount; ++i) {
+            stack[stackSize++] = children[i];
+        }
+    }
+    return false;
+}
+
+bool HeightPyramid::intersectQuad(int quadX, int quadZ, const glm::vec3 &origin, const glm::vec3 &direction,
+                                  float lift, float maxDistance, float &hitDistance) const {
+    // Same split as the terrain strips: (x, z+1)-(x+1, z) diagonal
+    glm::vec3 p00((float)quadX, sampleAt(quadX, quadZ) + lift, (float)quadZ);
+    glm::vec3 p10((float)(quadX + 1), sampleAt(quadX + 1, quadZ) + lift, (float)quadZ);
+    glm::vec3 p01((float)quadX, sampleAt(quadX, quadZ + 1) + lift, (float)(quadZ + 1));
+    glm::vec3 p11((float)(quadX + 1), sampleAt(quadX + 1, quadZ + 1) + lift, (float)(quadZ + 1));
+
+    float nearest = FLT_MAX, t;
+    if (intersectTriangle(origin, direction, p00, p01, p10, t) && t >= 0.0f && t <= maxDistance) {
+        nearest = t;
+    }
+    if (intersectTriangle(origin, direction, p01, p10, p11, t) && t >= 0.0f && t <= maxDistance) {
+        nearest = std::min(nearest, t);
+    }
+    if (nearest == FLT_MAX) {
+        return false;
+    }
+    hitDistance = nearest;
+    return true;
+}
@@ -0,0 +1,140 @@
+#include "lib/horizon_culler.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const float kColumnsPerRadian = HORIZON_CULLER_COLUMNS / (2.0f * 3.14159265358979f);
+// Occluders closer than this horizontally span too wide an angle to be useful
+const float kMinOccluderDistance = 1.0f;
+
+} // namespace
+
+bool HorizonCuller::columnSpan(float x0, float z0, float x1, float z1, float &first, float &last) const {
+    if (eye.x >= x0 && eye.x <= x1 && eye.z >= z0 && eye.z <= z1) {
+        return false;
+    }
+    // Corner angles relative to the centre angle never wrap, since the rectangle spans less than half a turn
+    float center = std::atan2(0.5f * (z0 + z1) - eye.z, 0.5f * (x0 + x1) - eye.x);
+    float lowest = 0.0f, highest = 0.0f;
+    const float cornersX[2] = {x0, x1}, cornersZ[2] = {z0, z1};
+    for (float cornerX : cornersX) {
+        for (float cornerZ : cornersZ) {
+            float relative = std::atan2(cornerZ - eye.z, cornerX - eye.x) - center;
+            if (relative > 3.14159265f) relative -= 6.28318531f;
+            if (relative < -3.14159265f) relative += 6.28318531f;
+            lowest = std::min(lowest, relative);
+            highest = std::max(highest, relative);
+        }
+    }
+    // Shift to [0, 2 * columns) so both ends stay ordered; columns are wrapped when used
+    if (center < 0.0f) center += 6.28318531f;
+    first = (center + lowest) * kColumnsPerRadian + HORIZON_CULLER_COLUMNS;
+    last = (center + highest) * kColumnsPerRadian + HORIZON_CULLER_COLUMNS;
+    return true;
+}
+
+void HorizonCuller::begin(const HeightPyramid &pyramid, const glm::vec3 &eyePosition) {
+    eye = eyePosition;
+    std::fill(horizon.begin(), horizon.end(), -std::numeric_limits<float>::infinity());
+    occluders.clear();
+    nextOccluder = 0;
+
+    int level = std::min(3, pyramid.getLevelCount() - 1);
+    while (level + 1 < pyramid.getLevelCount() &&
+           std::max(pyramid.getCellsX(level), pyramid.getCellsZ(level)) > HORIZON_CULLER_MAX_CELLS) {
+        ++level;
+    }
+    int cellSize = 1 << level;
+    int quadsX = pyramid.getCellsX(0), quadsZ = pyramid.getCellsZ(0);
+    for (int cellZ = 0; cellZ < pyramid.getCellsZ(level); ++cellZ) {
+        for (int cellX = 0; cellX < pyramid.getCellsX(level); ++cellX) {
+            float x0 = (float)(cellX * cellSize), x1 = (float)std::min((cellX + 1) * cellSize, quadsX);
+            float z0 = (float)(cellZ * cellSize), z1 = (float)std::min((cellZ + 1) * cellSize, quadsZ);
+            float dx = std::max({x0 - eye.x, 0.0f, eye.x - x1});
+            float dz = std::max({z0 - eye.z, 0.0f, eye.z - z1});
+            float nearDistance = std::sqrt(dx * dx + dz * dz);
+            if (nearDistance < kMinOccluderDistance) {
+                continue;
+            }
+            Occluder occluder;
+            if (!columnSpan(x0, z0, x1, z1, occluder.firstColumn, occluder.lastColumn)) {
+                continue;
+            }
+            float farX = std::max(std::abs(x0 - eye.x), std::abs(x1 - eye.x));
+            float farZ = std::max(std::abs(z0 - eye.z), std::abs(z1 - eye.z));
+            occluder.farDistance = std::sqrt(farX * farX + farZ * farZ);
+            // A sight line crossing the cell passes it somewhere between the near and far
+            // distance; the minimum height blocks it at the least favourable end
+            float rise = pyramid.getCellRange(level, cellX, cellZ).x - eye.y;
+            occluder.slope = rise / (rise > 0.0f ? occluder.farDistance : nearDistance);
+            occluders.push_back(occluder);
+        }
+    }
+    std::sort(occluders.begin(), occluders.end(),
+              [](const Occluder &a, const Occluder &b) { return a.farDistance < b.farDistance; });
+}
+
+void HorizonCuller::rasterize(const Occluder &occluder) {
+    // Only columns entirely inside the span: every sight line through them crosses the cell
+    int first = (int)std::ceil(occluder.firstColumn);
+    int last = (int)std::floor(occluder.lastColumn);
+    for (int column = first; column < last; ++column) {
+        float &blocked = horizon[column % HORIZON_CULLER_COLUMNS];
+        blocked = std::max(blocked, occluder.slope);
+    }
+}
+
+float HorizonCuller::getNearDistance(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const {
+    float dx = std::max({boxMin.x - eye.x, 0.0f, eye.x - boxMax.x});
+    float dz = std::max({boxMin.z - eye.z, 0.0f, eye.z - boxMax.z});
+    return std::sqrt(dx * dx + dz * dz);
+}
+
+void HorizonCuller::rasterizeTo(float distance) {
+    while (nextOccluder < occluders.size() && occluders[nextOccluder].farDistance <= distance) {
+        rasterize(occluders[nextOccluder++]);
+    }
+}
+
+void HorizonCuller::rasterizeBands(std::vector<float> &limits, std::vector<float> &horizons) {
+    limits.clear();
+    horizons.clear();
+    // Equal numbers of occluders per band, so the bands follow where the terrain is
+    size_t previousEnd = nextOccluder;
+    for (int band = 1; band <= HORIZON_CULLER_BANDS; ++band) {
+        size_t end = occluders.size() * band / HORIZON_CULLER_BANDS;
+        if (end <= previousEnd) {
+            continue;
+        }
+        previousEnd = end;
+        float limit = occluders[end - 1].farDistance;
+        rasterizeTo(limit);
+        limits.push_back(limit);
+        horizons.insert(horizons.end(), horizon.begin(), horizon.end());
+    }
+}
+
+bool HorizonCuller::isOccluded(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const {
+    if (nextOccluder == 0) {
+        return false;
+    }
+
+    float first, last;
+    if (!columnSpan(boxMin.x, boxMin.z, boxMax.x, boxMax.z, first, last)) {
+        return false;
+    }
+    float nearDistance = getNearDistance(boxMin, boxMax);
+    float farX = std::max(std::abs(boxMin.x - eye.x), std::abs(boxMax.x - eye.x));
+    float farZ = std::max(std::abs(boxMin.z - eye.z), std::abs(boxMax.z - eye.z));
+    float rise = boxMax.y - eye.y;
+    // Steepest sight line to any point of the box
+    float slope = rise / (rise > 0.0f ? nearDistance : std::sqrt(farX * farX + farZ * farZ));
+    for (int column = (int)std::floor(first); column <= (int)std::floor(last); ++column) {
+        if (slope >= horizon[column % HORIZON_CULLER_COLUMNS]) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,139 @@
+#include "lib/impostor.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+
+Impostor::~Impostor() {
+    if (atlas != 0) {
+        glDeleteTextures(1, &atlas);
+    }
+    if (instanceVBO != 0) {
+        glDeleteBuffers(1, &instanceVBO);
+    }
+    if (instanceVAO != 0) {
+        glDeleteVertexArrays(1, &instanceVAO);
+    }
+}
+
+bool Impostor::bake(Model &model, Shader &bakeShader) {
+    glm::vec3 boundsMin = model.GetBoundsMin(), boundsMax = model.GetBoundsMax();
+    if (boundsMin.x > boundsMax.x) {
+        std::cerr << "Impostor: model has no geometry" << std::endl;
+        return false;
+    }
+    // Radius of the circle any view direction's footprint fits in, as for the object bounds
+    radius = std::sqrt(std::max(boundsMin.x * boundsMin.x, boundsMax.x * boundsMax.x) +
+                       std::max(boundsMin.z * boundsMin.z, boundsMax.z * boundsMax.z));
+    heightRange = glm::vec2(boundsMin.y, boundsMax.y);
+
+    GLint previousFramebuffer, previousViewport[4];
+    GLfloat previousClearColor[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, previousClearColor);
+    GLboolean blendEnabled = glIsEnabled(GL_BLEND);
+
+    int atlasWidth = IMPOSTOR_FRAME_SIZE * IMPOSTOR_FRAMES, atlasHeight = IMPOSTOR_FRAME_SIZE;
+    if (atlas == 0) {
+        glGenTextures(1, &atlas);
+    }
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasWidth, atlasHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    GLuint framebuffer, depthBuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas, 0);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasWidth, atlasHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    if (complete) {
+        // Transparent background, alpha written as is so the atlas keeps the cut-out
+        glDisable(GL_BLEND);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glViewport(0, 0, atlasWidth, atlasHeight);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        bakeShader.use();
+        bakeShader.setMat4("model", glm::mat4(1.0f));
+        bakeShader.setMat4("projection", glm::ortho(-radius, radius, heightRange.x, heightRange.y, 0.0f, 4.0f * radius));
+        for (int frame = 0; frame < IMPOSTOR_FRAMES; ++frame) {
+            // Frame i is seen from model-space direction (sin a, 0, cos a); impostor.vs picks frames the same way
+            float angle = 2.0f * 3.14159265f * frame / IMPOSTOR_FRAMES;
+            glm::vec3 direction(std::sin(angle), 0.0f, std::cos(angle));
+            bakeShader.setMat4("view", glm::lookAt(direction * (2.0f * radius), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+            glViewport(frame * IMPOSTOR_FRAME_SIZE, 0, IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE);
+            model.Draw(bakeShader);
+        }
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+        std::cerr << "Impostor: bake framebuffer is incomplete" << std::endl;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previousFramebuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    glClearColor(previousClearColor[0], previousClearColor[1], previousClearColor[2], previousClearColor[3]);
+    if (blendEnabled) {
+        glEnable(GL_BLEND);
+    }
+    return complete;
+}
+
+void Impostor::bindAtlas(Shader &shader) const {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    shader.setInt("impostorAtlas", 0);
+    shader.setInt("impostorFrames", IMPOSTOR_FRAMES);
+    shader.setFloat("impostorRadius", radius);
+    shader.setVec2("impostorHeightRange", heightRange);
+}
+
+void Impostor::setInstanceBuffer(GLuint buffer) {
+    if (instanceVAO == 0) {
+        glGenVertexArrays(1, &instanceVAO);
+    }
+    glBindVertexArray(instanceVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void *)offsetof(ImpostorInstance, positionScale));
+    glVertexAttribDivisor(0, 1);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void *)offsetof(ImpostorInstance, rotationDither));
+    glVertexAttribDivisor(1, 1);
+}
+
+void Impostor::drawInstanced(Shader &shader, const ImpostorInstance *instances, size_t count) {
+    if (count == 0 || atlas == 0) {
+        return;
+    }
+    if (instanceVBO == 0) {
+        glGenBuffers(1, &instanceVBO);
+    }
+    setInstanceBuffer(instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(ImpostorInstance), instances, GL_STREAM_DRAW);
+
+    bindAtlas(shader);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)count);
+    glBindVertexArray(0);
+}
+
+void Impostor::drawIndirect(Shader &shader, GLuint instanceBuffer, GLsizei command) {
+    if (atlas == 0) {
+        return;
+    }
+    setInstanceBuffer(instanceBuffer);
+    bindAtlas(shader);
+    glDrawArraysIndirect(GL_TRIANGLE_STRIP, (void *)(command * 4 * sizeof(GLuint)));
+    glBindVertexArray(0);
+}
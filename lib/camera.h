@@ -154,6 +154,16 @@ public:
         // Calculate the desired camera position
         glm::vec3 desiredPosition = modelPosition + offset;
 
+        // Pull the boom in when a hill blocks the view of the player
+        const float boomRadius = 0.5f;
+        glm::vec3 pivot = modelPosition + glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 boom = desiredPosition - pivot;
+        float boomLength = glm::length(boom);
+        float hitDistance;
+        if (boomLength > 0.0f && terrain->sphereCast(pivot, boom / boomLength, boomRadius, boomLength, hitDistance)) {
+            desiredPosition = pivot + boom * (hitDistance / boomLength);
+        }
+
         // Ensure the camera doesn't go below the terrain
         float terrainHeight = terrain->getHeightAt(desiredPosition.x, desiredPosition.z);
         desiredPosition.y = glm::max(desiredPosition.y, terrainHeight + 2.0f); // Ensure camera stays above terrain
@@ -18,6 +18,7 @@ public:
     bool checkCollision(const glm::vec3 &playerPosition, float radius);
 
     glm::vec3 getPosition() const { return position; }
+    void setPosition(const glm::vec3 &newPosition) { position = newPosition; }
     glm::vec3 getLightColor() const { return lightColor; }
     bool isCollected() const { return collected; }
     void collect() {
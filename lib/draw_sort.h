@@ -0,0 +1,27 @@
+#ifndef DRAW_SORT_H
+#define DRAW_SORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 64-bit draw keys: the sort criterion in the high word, a payload (an index) in the low
+// word. Opaque draws are ordered by render state, blended draws back to front by a key
+// computed once per item, so neither needs comparisons that recompute distances.
+class DrawSort {
+public:
+    // State ordering for opaque and alpha-tested draws: shader, then texture, then batch
+    static uint64_t stateKey(uint32_t shader, uint32_t texture, uint32_t batch) {
+        return ((uint64_t)(shader & 0xFF) << 56) | ((uint64_t)(texture & 0xFFFFFF) << 32) | batch;
+    }
+    // Farthest first: non-negative float bits order like the floats, so the inverted bits order back to front
+    static uint64_t backToFrontKey(float distanceSquared, uint32_t payload);
+
+    static uint32_t payload(uint64_t key) { return (uint32_t)key; }
+
+    // Stable LSD radix sort on the high word, 8 bits per pass. Passes in which every key
+    // has the same digit are skipped, so clustered distances cost fewer than four.
+    static void radixSort(std::vector<uint64_t> &keys, std::vector<uint64_t> &scratch);
+};
+
+#endif // DRAW_SORT_H
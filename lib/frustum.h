@@ -0,0 +1,38 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// View frustum extracted from a view-projection matrix, used for AABB culling
+struct Frustum {
+    glm::vec4 planes[6]; // Left, right, bottom, top, near, far; normals point inwards
+
+    explicit Frustum(const glm::mat4 &vp) {
+        planes[0] = glm::vec4(vp[0][3] + vp[0][0], vp[1][3] + vp[1][0], vp[2][3] + vp[2][0], vp[3][3] + vp[3][0]);
+        planes[1] = glm::vec4(vp[0][3] - vp[0][0], vp[1][3] - vp[1][0], vp[2][3] - vp[2][0], vp[3][3] - vp[3][0]);
+        planes[2] = glm::vec4(vp[0][3] + vp[0][1], vp[1][3] + vp[1][1], vp[2][3] + vp[2][1], vp[3][3] + vp[3][1]);
+        planes[3] = glm::vec4(vp[0][3] - vp[0][1], vp[1][3] - vp[1][1], vp[2][3] - vp[2][1], vp[3][3] - vp[3][1]);
+        planes[4] = glm::vec4(vp[0][3] + vp[0][2], vp[1][3] + vp[1][2], vp[2][3] + vp[2][2], vp[3][3] + vp[3][2]);
+        planes[5] = glm::vec4(vp[0][3] - vp[0][2], vp[1][3] - vp[1][2], vp[2][3] - vp[2][2], vp[3][3] - vp[3][2]);
+        for (int i = 0; i < 6; ++i) {
+            planes[i] /= glm::length(glm::vec3(planes[i])); // Normalize so dot() gives a real distance
+        }
+    }
+
+    // True if the box is inside or intersects every plane
+    bool intersectsBox(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const {
+        for (int i = 0; i < 6; ++i) {
+            // Only the corner furthest along the plane normal needs testing
+            glm::vec4 corner(planes[i].x >= 0.0f ? boxMax.x : boxMin.x,
+                             planes[i].y >= 0.0f ? boxMax.y : boxMin.y,
+                             planes[i].z >= 0.0f ? boxMax.z : boxMin.z,
+                             1.0f);
+            if (glm::dot(planes[i], corner) < 0.0f) {
+                return false; // The box is outside this plane
+            }
+        }
+        return true;
+    }
+};
+
+#endif // FRUSTUM_H
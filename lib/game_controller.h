@@ -8,6 +8,7 @@
 #include "collectibles.h"
 #include "filesystem.h"
 #include "terrain.h"
+#include <functional>
 
 enum class GameState {
     Initializing, // Game setup
@@ -51,6 +52,18 @@ public:
             // Make the player spin (adjust speed as needed)
             isRotate = true;
             playerSpeed = 3.0f;
+
+            // The spin digs a trail of small craters; one every few frames keeps each edit small
+            digTimer -= deltaTime;
+            if (digTimer <= 0.0f) {
+                // Heights between samples blend their neighbours, so the ground moves up to one
+                // unit past the dig radius
+                glm::vec3 center = player->GetPosition();
+                glm::vec2 reach(digRadius + 1.0f);
+                keepCollectiblesAboveGround(glm::vec2(center.x, center.z) - reach, glm::vec2(center.x, center.z) + reach,
+                                            [&]() { return terrain->deform(center, digRadius, -digDepth); });
+                digTimer = digInterval;
+            }
         } else {
             isRotate = false;
             playerSpeed = 1.0f;
@@ -58,6 +71,11 @@ public:
     }
 
 private:
+    // Runs a terrain edit that changes the ground only inside [minXZ, maxXZ] horizontally, and
+    // moves the collectibles there by as much as the ground under them, so they keep their
+    // height above it. Placed objects are moved by the terrain itself.
+    void keepCollectiblesAboveGround(const glm::vec2 &minXZ, const glm::vec2 &maxXZ, const std::function<bool()> &edit);
+
     GLFWwindow *window;
     CollectibleManager &collectibleManager;
     SoundManager &soundManager;
@@ -76,6 +94,10 @@ private:
     bool isMoving = false;
     float boostTimer = 0.0f;          // Remaining boost time
     const float boostDuration = 6.0f; // Duration of the boost
+    float digTimer = 0.0f;            // Time until the next crater while boosting
+    const float digInterval = 0.1f;
+    const float digRadius = 2.5f;
+    const float digDepth = 0.15f;     // World units per crater
 };
 
 #endif // GAME_CONTROLLER_H
@@ -0,0 +1,90 @@
+#ifndef GPU_OBJECT_CULLER_H
+#define GPU_OBJECT_CULLER_H
+
+#include "shader.h"
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+class Impostor;
+class Terrain;
+
+// Invocations per work group of shaders/object_cull.comp
+const int GPU_CULL_GROUP_SIZE = 64;
+
+// GPU-driven drawing of the opaque placed objects. Every instance lives in a storage
+// buffer; object_cull.comp frustum and horizon culls them, picks their LOD level as
+// renderObjects does, appends the survivors to per-level output ranges and fills in the
+// instance counts of the indirect commands. All object meshes share one vertex and index
+// buffer, so the scene is one glMultiDrawElementsIndirect per texture plus one indirect
+// draw per impostor atlas: the CPU cost per frame depends on the number of models and
+// terrain cells, not of objects.
+class GpuObjectCuller {
+public:
+    GpuObjectCuller() = default;
+    ~GpuObjectCuller();
+    GpuObjectCuller(const GpuObjectCuller &) = delete;
+    GpuObjectCuller &operator=(const GpuObjectCuller &) = delete;
+
+    // Compute shaders, storage buffers and multi-draw indirect need OpenGL 4.3
+    static bool isSupported();
+
+    // Upload the terrain's opaque objects, their meshes and LOD levels; again after any change
+    bool build(const Terrain &terrain);
+    // Re-upload objects whose transform or bounds changed since build, e.g. after a terrain edit
+    void updateInstances(const Terrain &terrain, const std::vector<uint32_t> &objectIndices);
+    // Cull and draw; objectShader and impostorShader as for Terrain::renderObjects. The horizon
+    // bands are HorizonCuller::rasterizeBands output for this camera; without any, nothing is
+    // horizon culled.
+    void render(Shader &objectShader, Shader &impostorShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition,
+                const std::vector<float> &horizonLimits, const std::vector<float> &horizonBands);
+
+private:
+    // std430 layouts of object_cull.comp
+    struct GpuInstance {
+        glm::mat4 transform;
+        glm::vec4 sphere; // World bounding sphere
+        uint32_t batch;
+        float rotation; // Y rotation in radians and uniform scale, for the impostor level
+        float scale;
+        uint32_t padding;
+    };
+    struct GpuBatch {
+        glm::vec4 lod;     // Simplified and impostor start distances (0 = none), fade fraction
+        uint32_t levels[4]; // Counter of each level, ~0u when the level is missing
+    };
+    struct DrawElementsIndirectCommand {
+        GLuint count, instanceCount, firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+    struct DrawArraysIndirectCommand {
+        GLuint count, instanceCount, first, baseInstance;
+    };
+    // Commands [firstCommand, firstCommand + commandCount) share one diffuse texture
+    struct TextureRange {
+        GLuint texture;
+        GLsizei firstCommand, commandCount;
+    };
+    struct ImpostorDraw {
+        Impostor *impostor;
+        GLsizei command; // Index into the impostor commands
+    };
+
+    static GpuInstance makeInstance(const Terrain &terrain, size_t object);
+    void release();
+
+    GLuint cullProgram = 0;
+    GLuint meshVAO = 0, meshVBO = 0, meshEBO = 0;
+    GLuint instanceBuffer = 0, batchBuffer = 0, counterBuffer = 0, counterBaseBuffer = 0, commandCounterBuffer = 0;
+    GLuint meshCommandBuffer = 0, impostorCommandBuffer = 0;
+    GLuint transformOutput = 0, impostorOutput = 0;
+    GLuint horizonBuffer = 0; // HorizonCuller bands, rewritten every frame
+    GLuint instanceCount = 0, meshCommandCount = 0, impostorCommandCount = 0, counterCount = 0;
+    std::vector<TextureRange> textureRanges;
+    std::vector<ImpostorDraw> impostorDraws;
+    std::vector<uint32_t> instanceOfObject; // Index into instanceBuffer per object, ~0u when not drawn here
+};
+
+#endif // GPU_OBJECT_CULLER_H
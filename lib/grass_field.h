@@ -0,0 +1,62 @@
+#ifndef GRASS_FIELD_H
+#define GRASS_FIELD_H
+
+#include "shader.h"
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+class Terrain;
+
+// Grass tiles are the height pyramid's level 3 cells, whose height ranges bound their blades
+const int GRASS_TILE_LEVEL = 3;
+const int GRASS_TILE_SIZE = 1 << GRASS_TILE_LEVEL;
+const int GRASS_BLADE_VERTICES = 7; // Triangle strip: three tapering segments and the tip
+const float GRASS_MAX_BEND = 0.45f;   // Forward lean of a blade tip, as a fraction of its height (grass.vs)
+
+struct GrassSettings {
+    float density = 48.0f;             // Blades per square world unit near the camera
+    float fullDensityDistance = 15.0f; // Density thins out linearly from here...
+    float maxDistance = 60.0f;         // ...to nothing here
+    glm::vec2 heightRange = glm::vec2(0.0f, 10.0f); // World-space terrain height that grows grass
+    float maxSlope = 0.6f;                          // Rise over run
+    float bladeHeight = 0.5f, bladeWidth = 0.06f;   // Largest blade; each one varies below that
+    float sway = 0.6f;                              // Tip lean at unit wind, as a fraction of the blade height
+};
+
+// Procedural grass over the whole terrain with no per-blade data. Every visible tile is one
+// indirect instanced draw of GRASS_BLADE_VERTICES vertices per blade; shaders/grass.vs places
+// and shapes each blade from a hash of its tile and instance index, and stands it on the
+// terrain's height and normal textures. A tile draws a prefix of its blades sized by its
+// distance, and blades shrink away as their rank passes the density at their own distance,
+// so thinning out is seamless. The CPU cost is a loop over the tiles in range.
+class GrassField {
+public:
+    explicit GrassField(const GrassSettings &settings);
+    ~GrassField();
+    GrassField(const GrassField &) = delete;
+    GrassField &operator=(const GrassField &) = delete;
+
+    // Multi-draw indirect needs OpenGL 4.3
+    static bool isSupported();
+
+    // grassShader is shaders/grass.vs / grass.fs with the light and wind uniforms already set;
+    // wind is the same vector as its wind uniform, for the tile bounds
+    void render(const Terrain &terrain, Shader &grassShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition,
+                const glm::vec2 &wind);
+
+private:
+    struct DrawArraysIndirectCommand {
+        GLuint count, instanceCount, first, baseInstance;
+    };
+    // Fraction of a tile's blades drawn at a distance; grass.vs computes the same per blade
+    float densityAt(float distance) const;
+
+    GrassSettings settings;
+    GLuint bladesPerTile;
+    GLuint vao = 0, tileBuffer = 0, commandBuffer = 0;
+    std::vector<glm::vec2> tileOrigins;               // Per visible tile, attribute 0 of grass.vs
+    std::vector<DrawArraysIndirectCommand> commands; // baseInstance selects the tile origin
+};
+
+#endif // GRASS_FIELD_H
@@ -0,0 +1,57 @@
+#ifndef HEIGHT_PYRAMID_H
+#define HEIGHT_PYRAMID_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Min/max mip chain over a heightfield for hierarchical ray casts. Level k holds the
+// height range of 2^k x 2^k quads; level 0 is read from the heights directly, so the
+// stored levels add about a third of a float pair per four quads.
+class HeightPyramid {
+public:
+    // heights: row-major samples in [0, 1], kept by pointer and read by the leaf tests;
+    // rebuild when they change. heightScale: world height of a sample of 1.
+    // storedRanges: levels saved with getStoredRanges for the same heights, copied
+    // instead of recomputed.
+    HeightPyramid(const float *heights, int width, int height, float heightScale,
+                  const glm::vec2 *storedRanges = nullptr);
+
+    // Distance along `direction` (normalized) to the first hit with the triangulated surface
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &hitDistance) const;
+    // Same for a sphere, approximated by lifting the surface by the radius. Exact on flat
+    // ground; on steep slopes the sphere can sink in by up to radius * (1 / cos(slope) - 1).
+    bool sphereCast(const glm::vec3 &origin, const glm::vec3 &direction, float radius, float maxDistance,
+                    float &hitDistance) const;
+
+    // Refresh the cells over samples [x0, x1) x [z0, z1) after those heights changed
+    void update(int x0, int z0, int x1, int z1);
+
+    int getLevelCount() const { return (int)levels.size() + 1; }
+    // World-space (min, max) height of a cell; cell coordinates are in units of 2^level quads
+    glm::vec2 getCellRange(int level, int cellX, int cellZ) const;
+    int getCellsX(int level) const { return (quadsX + (1 << level) - 1) >> level; }
+    int getCellsZ(int level) const { return (quadsZ + (1 << level) - 1) >> level; }
+    // Every stored level back to back, finest first
+    std::vector<glm::vec2> getStoredRanges() const;
+
+private:
+    struct Level {
+        int cellsX, cellsZ;
+        std::vector<glm::vec2> range; // World-space (min, max) per cell, row-major
+    };
+
+    // Recompute cells [cellX0, cellX1) x [cellZ0, cellZ1) of levels[levelIndex] from the level below
+    void buildCells(size_t levelIndex, int cellX0, int cellZ0, int cellX1, int cellZ1);
+    bool cast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float lift, float &hitDistance) const;
+    bool intersectQuad(int quadX, int quadZ, const glm::vec3 &origin, const glm::vec3 &direction, float lift,
+                       float maxDistance, float &hitDistance) const;
+    float sampleAt(int x, int z) const { return heights[(size_t)z * width + x] * heightScale; }
+
+    const float *heights;
+    int width, height;
+    int quadsX, quadsZ;
+    float heightScale;
+    std::vector<Level> levels; // levels[0] is pyramid level 1
+};
+
+#endif // HEIGHT_PYRAMID_H
@@ -0,0 +1,57 @@
+#ifndef HORIZON_CULLER_H
+#define HORIZON_CULLER_H
+
+#include "height_pyramid.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Azimuth bins of the horizon buffer around the eye (about a third of a degree each)
+const int HORIZON_CULLER_COLUMNS = 1024;
+// Occluder cells are taken from the pyramid level with at most this many cells per side
+const int HORIZON_CULLER_MAX_CELLS = 64;
+// Horizons of growing occluder distance for testing every object at once (rasterizeBands)
+const int HORIZON_CULLER_BANDS = 16;
+
+// CPU occlusion culling against the terrain itself. Coarse pyramid cells are rasterized
+// front to back into a 1D horizon: per azimuth column, the steepest elevation the ground
+// is guaranteed to block. Each cell occludes with its minimum height at its least
+// favourable distance, so the horizon never claims more than the real terrain hides.
+// A box is occluded when its top lies below the horizon in every column it covers;
+// visiting boxes nearest first lets the horizon grow as the walk moves outwards.
+class HorizonCuller {
+public:
+    // Collect and sort the occluder cells for this eye position; resets the horizon
+    void begin(const HeightPyramid &pyramid, const glm::vec3 &eye);
+    // Rasterize the occluders lying entirely within `distance`. Calls must not decrease
+    // the distance; boxes tested afterwards must be at least this far away.
+    void rasterizeTo(float distance);
+    // Against the occluders rasterized so far
+    bool isOccluded(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const;
+    // For the GPU, which tests every object at once instead of walking them nearest first:
+    // rasterize all occluders in up to HORIZON_CULLER_BANDS steps of increasing distance and
+    // keep the horizon after each. Band b covers the occluders within limits[b] and is row b
+    // of horizons (HORIZON_CULLER_COLUMNS each); a box may be tested against the last band
+    // whose limit does not exceed its near distance.
+    void rasterizeBands(std::vector<float> &limits, std::vector<float> &horizons);
+    // Horizontal distance from the eye to the nearest point of the box footprint
+    float getNearDistance(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const;
+
+private:
+    struct Occluder {
+        float farDistance;  // Horizontal distance to the farthest corner
+        float firstColumn;  // Angular span in column units, firstColumn <= lastColumn
+        float lastColumn;
+        float slope;        // Elevation (rise over run) the cell is guaranteed to block
+    };
+
+    // Angular span of an xz rectangle seen from the eye, in column units; false if it contains the eye
+    bool columnSpan(float x0, float z0, float x1, float z1, float &first, float &last) const;
+    void rasterize(const Occluder &occluder);
+
+    glm::vec3 eye;
+    std::vector<Occluder> occluders; // Sorted by farDistance
+    size_t nextOccluder = 0;
+    std::vector<float> horizon = std::vector<float>(HORIZON_CULLER_COLUMNS);
+};
+
+#endif // HORIZON_CULLER_H
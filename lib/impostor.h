@@ -0,0 +1,52 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include "model.h"
+#include "shader.h"
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Views around the Y axis baked per impostor, and the pixel size of each view
+const int IMPOSTOR_FRAMES = 8;
+const int IMPOSTOR_FRAME_SIZE = 256;
+
+// Per-instance data of impostor draws, attributes 0 and 1 of impostor.vs. Two vec4s so
+// the std430 records object_cull.comp writes can be drawn from directly.
+struct ImpostorInstance {
+    glm::vec4 positionScale;  // World position of the model origin, uniform scale
+    glm::vec4 rotationDither; // Y rotation in radians, dither value (see model_instanced.fs), wind amplitude
+                              // and inverse height (see model_instanced.vs)
+};
+
+// Multi-angle billboard of a model for far distances: IMPOSTOR_FRAMES orthographic views
+// around the Y axis, baked side by side into one RGBA atlas at load time. At draw time a
+// camera-facing quad shows the frame closest to the direction it is seen from, so a far
+// tree costs two triangles whatever its mesh.
+class Impostor {
+public:
+    Impostor() = default;
+    ~Impostor();
+    Impostor(const Impostor &) = delete;
+    Impostor &operator=(const Impostor &) = delete;
+
+    // Render the model's views with bakeShader (model.vs / model.fs uniforms). The bound
+    // framebuffer, viewport, clear colour and blending are restored afterwards.
+    bool bake(Model &model, Shader &bakeShader);
+    // Draw camera-facing quads with impostor.vs / impostor.fs; the shader must be in use
+    void drawInstanced(Shader &shader, const ImpostorInstance *instances, size_t count);
+    // Same with ImpostorInstances from instanceBuffer and a DrawArraysIndirectCommand at
+    // index `command` of the bound GL_DRAW_INDIRECT_BUFFER
+    void drawIndirect(Shader &shader, GLuint instanceBuffer, GLsizei command);
+
+private:
+    void bindAtlas(Shader &shader) const;
+    // Point attributes 0 and 1 of instanceVAO at a buffer of ImpostorInstances
+    void setInstanceBuffer(GLuint buffer);
+
+    GLuint atlas = 0;
+    GLuint instanceVAO = 0, instanceVBO = 0; // The quad corners come from gl_VertexID
+    float radius = 0.0f;                     // Horizontal extent around the model origin
+    glm::vec2 heightRange = glm::vec2(0.0f); // Model-space bottom and top
+};
+
+#endif // IMPOSTOR_H
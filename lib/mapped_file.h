@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The OS pages data in on first touch,
+// so large raw files are read without an intermediate copy.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    const void *data() const { return mappedData; }
+    size_t size() const { return mappedSize; }
+
+    // Drop the pages of a range that has been read, so reading the file front to back
+    // keeps only the part in use resident. The range stays readable; it is paged in again.
+    void release(size_t offset, size_t length);
+
+private:
+    const void *mappedData = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+};
+
+#endif // MAPPED_FILE_H
@@ -60,6 +60,40 @@ public:
 
     // ��Ⱦ mesh
     void Draw(Shader shader) {
+        bindTextures(shader);
+
+        // ���� mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        // ����ϰ�ߣ�����Ĭ������
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Draw instanceCount copies; per-instance model matrices come from the buffer set with SetInstanceBuffer
+    void DrawInstanced(Shader &shader, GLsizei instanceCount) {
+        bindTextures(shader);
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0, instanceCount);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Attach a buffer of tightly packed mat4s as attributes 5-8, advancing once per instance
+    void SetInstanceBuffer(unsigned int buffer) {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (int column = 0; column < 4; ++column) {
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(sizeof(glm::vec4) * column));
+            glVertexAttribDivisor(5 + column, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+private:
+    void bindTextures(Shader &shader) {
         // �󶨺��ʵ�����
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
@@ -91,17 +125,8 @@ public:
             //     shader.setVec3("materialColor", textures[i].color);
             // }
         }
-
-        // ���� mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // ����ϰ�ߣ�����Ĭ������
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
     /*  ��Ⱦ����  */
     unsigned int VBO, EBO;
 
@@ -0,0 +1,62 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "mesh.h"
+#include <cstddef>
+#include <vector>
+
+// FIFO size used when reporting ACMR, a typical post-transform cache size
+const int MESH_OPTIMIZER_REPORT_CACHE = 16;
+
+// Load-time optimization pass for indexed triangle lists
+class MeshOptimizer {
+public:
+    struct Stats {
+        size_t verticesBefore = 0, verticesAfter = 0;
+        size_t triangles = 0;
+        float acmrBefore = 0.0f, acmrAfter = 0.0f; // Average cache misses per triangle
+
+        void add(const Stats &other); // Triangle-weighted accumulation across meshes
+    };
+
+    // Weld, reorder for the vertex cache, optionally sort clusters for overdraw, then reorder vertices for fetch
+    static Stats optimize(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, bool optimizeOverdraw = true);
+
+    // Merge bitwise-identical vertices and remap the indices; returns the new vertex count
+    static size_t weldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+    // Tom Forsyth's linear-speed vertex cache optimization
+    static void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount);
+    // Split the cache-optimized order into clusters at cache flushes and draw outward-facing clusters first
+    static void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices);
+    // Renumber vertices in order of first use so fetches walk the buffer linearly
+    static void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+    // Vertex clustering on a uniform grid of cellSize: each occupied cell keeps the vertex closest to
+    // the cell's mean position, collapsed and duplicate triangles are dropped. Coarse but fast and
+    // topology-agnostic, which suits distant LODs of foliage. Returns the new triangle count.
+    static size_t simplifyClusters(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, float cellSize);
+
+    // Misses per triangle of a FIFO cache fed with the index stream. Primitive restart indices are skipped,
+    // so strips can be measured too; pass their triangle count.
+    template <typename Index>
+    static float computeACMR(const Index *indices, size_t indexCount, size_t triangleCount, size_t vertexCount,
+                             int cacheSize = MESH_OPTIMIZER_REPORT_CACHE, Index restartIndex = (Index)~0u) {
+        if (triangleCount == 0) {
+            return 0.0f;
+        }
+        std::vector<size_t> insertedAt(vertexCount, 0); // Miss counter value when the vertex entered the cache, 0 = never
+        size_t misses = 0;
+        for (size_t i = 0; i < indexCount; ++i) {
+            Index index = indices[i];
+            if (index == restartIndex) {
+                continue;
+            }
+            if (insertedAt[index] == 0 || misses + 1 - insertedAt[index] > (size_t)cacheSize) {
+                ++misses;
+                insertedAt[index] = misses;
+            }
+        }
+        return (float)misses / (float)triangleCount;
+    }
+};
+
+#endif // MESH_OPTIMIZER_H
@@ -15,8 +15,11 @@
 #include <stb/stb_image.h>
 
 #include "mesh.h"
+#include "mesh_optimizer.h"
 #include "shader.h"
 
+#include <algorithm>
+#include <cfloat>
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -50,6 +53,45 @@ public:
             meshes[i].Draw(shader);
         }
     }
+    // One instanced draw per mesh for all the given model matrices. The matrices are
+    // streamed into a buffer owned by the model, orphaned every call.
+    void DrawInstanced(Shader &shader, const glm::mat4 *transforms, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        if (instanceVBO == 0) {
+            glGenBuffers(1, &instanceVBO);
+            for (auto &mesh : meshes) {
+                mesh.SetInstanceBuffer(instanceVBO);
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), transforms, GL_STREAM_DRAW);
+        for (auto &mesh : meshes) {
+            mesh.DrawInstanced(shader, (GLsizei)count);
+        }
+    }
+    // Copy with every mesh reduced by MeshOptimizer::simplifyClusters on a grid of `fraction` times
+    // the largest bounds extent; textures are shared with this model
+    Model Simplified(float fraction) const {
+        Model simplified(*this);
+        simplified.meshes.clear();
+        simplified.instanceVBO = 0;
+        glm::vec3 extent = boundsMax - boundsMin;
+        float cellSize = fraction * std::max(extent.x, std::max(extent.y, extent.z));
+        size_t trianglesBefore = 0, trianglesAfter = 0;
+        for (const auto &mesh : meshes) {
+            vector<Vertex> vertices = mesh.vertices;
+            vector<unsigned int> indices = mesh.indices;
+            trianglesBefore += indices.size() / 3;
+            trianglesAfter += MeshOptimizer::simplifyClusters(vertices, indices, cellSize);
+            if (!indices.empty()) {
+                simplified.meshes.push_back(Mesh(vertices, indices, mesh.textures));
+            }
+        }
+        cout << "Simplified " << directory << ": triangles " << trianglesBefore << " -> " << trianglesAfter << endl;
+        return simplified;
+    }
     void SetPosition(const glm::vec3 &position) {
         this->position = position;
     }
@@ -78,9 +120,17 @@ public:
         return 0; // Return 0 if no diffuse texture is found
     }
 
+    // Model-space bounding box over all meshes
+    glm::vec3 GetBoundsMin() const { return boundsMin; }
+    glm::vec3 GetBoundsMax() const { return boundsMax; }
+
 private:
     glm::vec3 position;
     glm::vec3 rotation;
+    MeshOptimizer::Stats optimizerStats; // Accumulated over all meshes of the model
+    glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+    glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+    unsigned int instanceVBO = 0; // Per-instance model matrices for DrawInstanced
     /*  ����  */
     // ���ļ�����ģ��֧�� ASSIMP ��չ���洢���������ɵ���������
     void loadModel(string const &path) {
@@ -98,6 +148,9 @@ private:
 
         // �ݹ鴦�� ASSIMP �ĸ��ڵ�
         processNode(scene->mRootNode, scene);
+
+        cout << "Optimized " << path << ": vertices " << optimizerStats.verticesBefore << " -> " << optimizerStats.verticesAfter
+             << ", ACMR " << optimizerStats.acmrBefore << " -> " << optimizerStats.acmrAfter << endl;
     }
 
     // �Եݹ鷽ʽ�����ڵ�
@@ -129,6 +182,8 @@ private:
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            boundsMin = glm::min(boundsMin, vector);
+            boundsMax = glm::max(boundsMax, vector);
 
             // Normal
             if (mesh->mNormals) {
@@ -194,6 +249,9 @@ private:
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
         // ����һ�� Mesh ����
+        // Reorder for the post-transform cache and drop duplicate vertices before upload
+        optimizerStats.add(MeshOptimizer::optimize(vertices, indices));
+
         return Mesh(vertices, indices, textures);
     }
 
@@ -0,0 +1,53 @@
+#ifndef OBJECT_GRID_H
+#define OBJECT_GRID_H
+
+#include "frustum.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Side of a grid cell in world units; one terrain chunk
+const float OBJECT_GRID_CELL_SIZE = 32.0f;
+
+// Uniform grid over the terrain's xz extent for placed objects. Items go to the cell
+// holding their position, and each cell keeps the box enclosing all its items' boxes
+// (a loose grid), so a cell test stands for every item in it.
+class ObjectGrid {
+public:
+    struct Cell {
+        glm::vec3 boundsMin, boundsMax; // Union of the item boxes; empty cells are inverted
+        std::vector<uint32_t> items;
+        std::vector<glm::vec3> positions; // Parallel to items
+    };
+
+    // Drop all items and cover [0, width) x [0, depth)
+    void reset(float width, float depth, float cellSize = OBJECT_GRID_CELL_SIZE);
+    // Positions outside the extent are clamped to the border cells
+    void insert(uint32_t item, const glm::vec3 &position, const glm::vec3 &boxMin, const glm::vec3 &boxMax);
+    // New height of an item's position; its xz, and so its cell, stay the same
+    void setHeight(uint32_t item, const glm::vec3 &position);
+    // Recompute the boxes of the cells overlapping [minXZ, maxXZ] from boxes indexed by item,
+    // so they shrink as well as grow after items change
+    void refit(const std::vector<glm::vec3> &boxMin, const std::vector<glm::vec3> &boxMax, const glm::vec2 &minXZ,
+               const glm::vec2 &maxXZ);
+
+    // Non-empty cells whose box intersects the frustum, by increasing horizontal distance from the eye
+    void selectVisible(const Frustum &frustum, const glm::vec3 &eye, std::vector<const Cell *> &visible) const;
+    // Items whose position lies within `radius` of `center`, in no particular order
+    void queryRadius(const glm::vec3 &center, float radius, std::vector<uint32_t> &result) const;
+    // Items whose position lies in [minXZ, maxXZ] horizontally, in no particular order
+    void queryRect(const glm::vec2 &minXZ, const glm::vec2 &maxXZ, std::vector<uint32_t> &result) const;
+
+private:
+    int cellIndexX(float x) const;
+    int cellIndexZ(float z) const;
+
+    float cellSize = OBJECT_GRID_CELL_SIZE;
+    int cellsX = 0, cellsZ = 0;
+    std::vector<Cell> cells; // Row-major
+    // Scratch for selectVisible: (distance, cell)
+    mutable std::vector<std::pair<float, const Cell *>> sortedCells;
+};
+
+#endif // OBJECT_GRID_H
@@ -0,0 +1,66 @@
+#ifndef OBJECT_PLACER_H
+#define OBJECT_PLACER_H
+
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// PCG32 (XSH RR): 64-bit LCG state, permuted 32-bit output. Each stream id selects an
+// independent sequence, so every tile or object can own one and results do not depend
+// on which thread ran it.
+struct Pcg32 {
+    uint64_t state = 0, increment = 1;
+
+    Pcg32(uint64_t seed, uint64_t stream) : increment((stream << 1u) | 1u) {
+        next();
+        state += seed;
+        next();
+    }
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + increment;
+        uint32_t shifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rotation = (uint32_t)(old >> 59u);
+        return (shifted >> rotation) | (shifted << ((32u - rotation) & 31u));
+    }
+    float nextFloat() { return (next() >> 8) * (1.0f / 16777216.0f); } // [0, 1)
+};
+
+// Where objects of one type may stand, for Terrain::placeObjects
+struct ObjectPlacementRules {
+    int count = 0;
+    float minSpacing = 0.0f;                       // Distance kept between objects of this placement
+    float minHeight = -FLT_MAX, maxHeight = FLT_MAX; // World-space terrain height
+    float maxSlope = 100.0f;                       // Rise over run (1 = 45 degrees)
+    float minScale = 1.0f, maxScale = 1.0f;
+    std::string densityMaskPath; // Optional greyscale image over the whole terrain: chance to keep a sample
+    uint64_t seed = 1;
+};
+
+// Blue-noise (Poisson-disk) placement. Darts are thrown cell by cell into a background grid
+// of radius / sqrt(2) cells, which hold one sample each. Tiles of the grid are processed in
+// four phases, 2x2 colours, so tiles running at the same time are at least a tile apart and
+// never see each other's samples; each tile draws from its own PCG stream, which makes the
+// result independent of the thread count. The radius is fitted to the valid area so the set
+// ends up slightly above the requested count, and the surplus is dropped at random.
+class ObjectPlacer {
+public:
+    // Whether a sample at (x, z) is allowed, its height, and the chance to keep it. Called
+    // concurrently from worker threads.
+    using AcceptFunction = std::function<bool(float x, float z, float &height, float &keepProbability)>;
+
+    // Exactly `count` points in [0, width) x [0, depth), at least minSpacing apart, when that
+    // many fit; otherwise as many as fit, with a warning
+    static std::vector<glm::vec3> place(float width, float depth, int count, float minSpacing, uint64_t seed,
+                                        const AcceptFunction &accept);
+
+private:
+    // attempt selects the PCG streams, so every radius tried gets fresh ones
+    static std::vector<glm::vec3> sampleDisk(float width, float depth, float radius, uint64_t seed, int attempt,
+                                             const AcceptFunction &accept);
+};
+
+#endif // OBJECT_PLACER_H
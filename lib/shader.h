@@ -38,15 +38,15 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode = expandIncludes(vShaderStream.str(), vertexPath);
+            fragmentCode = expandIncludes(fShaderStream.str(), fragmentPath);
             // if geometry shader path is present, also load a geometry shader
             if (geometryPath != nullptr) {
                 gShaderFile.open(geometryPath);
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = expandIncludes(gShaderStream.str(), geometryPath);
             }
         } catch (std::ifstream::failure e) {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
@@ -141,6 +141,29 @@ public:
     }
 
 private:
+    // replaces each #include "file" line with that file, looked up next to the including shader
+    // ------------------------------------------------------------------------
+    static std::string expandIncludes(const std::string &code, const std::string &path) {
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        std::istringstream lines(code);
+        std::stringstream expanded;
+        std::string line;
+        while (std::getline(lines, line)) {
+            size_t open = line.find('"');
+            if (line.compare(0, 8, "#include") != 0 || open == std::string::npos) {
+                expanded << line << "\n";
+                continue;
+            }
+            std::string includePath = directory + line.substr(open + 1, line.find('"', open + 1) - open - 1);
+            std::ifstream includeFile(includePath);
+            if (!includeFile) {
+                std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: " << includePath << std::endl;
+                continue;
+            }
+            expanded << includeFile.rdbuf() << "\n";
+        }
+        return expanded.str();
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type) {
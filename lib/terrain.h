@@ -1,68 +1,304 @@
 #ifndef TERRAIN_H
 #define TERRAIN_H
 
+#include "frustum.h"
+#include "gpu_object_culler.h"
+#include "grass_field.h"
+#include "height_pyramid.h"
+#include "horizon_culler.h"
+#include "impostor.h"
 #include "model.h"
+#include "object_grid.h"
+#include "object_placer.h"
 #include "shader.h"
+#include "terrain_material.h"
+#include "terrain_normals.h"
+#include "terrain_quadtree.h"
+#include "terrain_streamer.h"
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <stb/stb_image.h> // For loading PNG heightmap images
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+// Side length of a terrain chunk in quads. Each chunk is frustum culled on its own.
+const int TERRAIN_CHUNK_SIZE = 32;
+static_assert(TERRAIN_CHUNK_SIZE <= 255, "Chunk-local vertex positions are stored in 8 bits");
+// Width in quads of the vertical bands grid strips are cut into, so the rows of a band stay in the post-transform cache
+const int TERRAIN_STRIP_BAND = 16;
+// Primitive restart index of the 16-bit terrain index buffers
+const GLushort TERRAIN_RESTART_INDEX = 0xFFFF;
+// Quads per side of the grid patch every CDLOD node is drawn with
+const int CDLOD_PATCH_SIZE = 16;
+// Object LOD: fraction of a level's start distance over which it dithers in from the previous one
+const float OBJECT_LOD_FADE = 0.15f;
+// Clustering cell of the simplified object level, as a fraction of the model's largest extent
+const float OBJECT_LOD_SIMPLIFY_CELL = 1.0f / 24.0f;
+
+enum class TerrainRenderMode {
+    Mesh,     // Full-resolution chunked mesh
+    CDLOD,    // Quadtree LOD with vertex morphing, heights read from a texture
+    Displaced // Full resolution, one shared patch displaced by the heightmap texture per visible chunk
+};
+
 class Terrain {
 public:
-    Terrain(const std::string &heightmapPath, float scale, int width, int height);
+    // heightmapPath: an 8- or 16-bit image (first channel is used), a square raw
+    // file of little-endian uint16 (.r16) or float samples in [0, 1] (.f32), a
+    // directory of tiles written by bakeTiles, which is streamed in around the player,
+    // or "procedural:key=value,..." to generate the heights (see TerrainGeneratorSettings;
+    // the size defaults to width x height)
+    Terrain(const std::string &heightmapPath, float scale, int width, int height,
+            TerrainRenderMode mode = TerrainRenderMode::Mesh);
     ~Terrain();
 
     void generateTerrain();
     bool loadTexture(const std::string &texturePath);
-    void render(Shader &shader, const glm::mat4 &vp); // Updated to pass the view-projection matrix
+    // Splat material blended in the terrain fragment shader; takes over from loadTexture.
+    // With a weight map the layers' height and slope ranges are ignored.
+    bool loadMaterial(const std::vector<TerrainLayer> &layers, const std::string &weightMapPath = "");
+    void render(Shader &shader, const glm::mat4 &vp, const glm::vec3 &cameraPosition);
+    void setRenderMode(TerrainRenderMode mode);
+    TerrainRenderMode getRenderMode() const { return renderMode; }
+    // Load new heights from disk. GPU-displaced modes only update the height texture.
+    bool reloadHeightmap(const std::string &path);
+    // Split the loaded heightmap into streamable tiles (see TerrainStreamer)
+    bool bakeTiles(const std::string &directory, int tileSize) const;
+    // Streamed terrain: load tiles around the focus. Blocking is for load time only.
+    void updateStreaming(const glm::vec3 &focusPosition, bool waitForTiles = false);
+    bool isStreamed() const { return streamer != nullptr; }
     float getHeightAt(float x, float z) const;
+    // getHeightAt for many points at once, four per step with SSE2. Points off the grid are clamped onto it.
+    void getHeightsAt(const glm::vec2 *positions, float *heights, size_t count) const;
+#ifdef TERRAIN_BENCHMARK
+    // Times getHeightAt against getHeightsAt on random points and checks they agree
+    void benchmarkHeightQueries(size_t count) const;
+#endif
+    // Baked surface normal, bilinearly filtered like getHeightAt
+    glm::vec3 getNormalAt(float x, float z) const;
+    // Height change per world unit along x and z
+    glm::vec2 getGradientAt(float x, float z) const;
+    // Steepness as rise over run (0 = flat, 1 = 45 degrees)
+    float getSlopeAt(float x, float z) const;
+    // Raise (delta > 0) or dig (delta < 0) a smooth circular region by up to delta world units.
+    // Only the touched chunks, pyramid cells and texture rectangles are updated.
+    // Placed objects in the region are moved onto the new ground.
+    bool deform(const glm::vec3 &center, float radius, float delta);
+    // Undo every deform since the heightmap was loaded; false if there was none
+    bool resetDeformations();
+    // Distance along a normalized direction to the first hit with the terrain mesh, false on a
+    // miss within maxDistance. Streamed terrain has no pyramid and always misses.
+    bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, float &hitDistance) const;
+    // raycast for a sphere of the given radius (see HeightPyramid::sphereCast)
+    bool sphereCast(const glm::vec3 &origin, const glm::vec3 &direction, float radius, float maxDistance,
+                    float &hitDistance) const;
     int getWidth() const { return terrainWidth; }
     int getHeight() const { return terrainHeight; }
     // New method: get bounding box corners
     glm::vec3 getMinCorner() const { return minCorner; }
     glm::vec3 getMaxCorner() const { return maxCorner; }
 
-    void addModel(const std::string &type, const std::string &modelPath); // Load models
+    // Load models. Blended types are drawn after everything else, back to front and
+    // without depth writes; the rest are alpha-tested and drawn in state order.
+    void addModel(const std::string &type, const std::string &modelPath, bool blended = false);
+    // placeObjects with spread as the minimum spacing and a seed from rand()
     void generateObjects(int count, const std::string &type,
                          float minHeight, float maxHeight, float spread,
                          float minScale, float maxScale);
-    void renderObjects(Shader &objectShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition);
+    // Blue-noise placement of rules.count objects of a type (see ObjectPlacer), the same
+    // for the same seed and terrain. Returns how many were placed.
+    int placeObjects(const std::string &type, const ObjectPlacementRules &rules);
+    // Distance LOD for the models of an opaque type: a clustered simplification beyond
+    // simplifiedDistance and a baked billboard impostor beyond impostorDistance (0 skips a
+    // level). Each level dithers in over OBJECT_LOD_FADE of its distance. Call after addModel.
+    bool setObjectLod(const std::string &type, float simplifiedDistance, float impostorDistance);
+    // Wind response of a type: how far the tops of its objects lean at a wind strength of 1,
+    // as a fraction of their height. 0 (the default) keeps them still. The object shaders
+    // animate from their time and wind uniforms, so this costs nothing per frame.
+    bool setObjectSway(const std::string &type, float sway);
+    // objectShader must take the model matrix per instance (shaders/model_instanced.vs),
+    // impostorShader draws the impostor level (shaders/impostor.vs)
+    void renderObjects(Shader &objectShader, Shader &impostorShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition);
+    // Indices of the placed objects whose position lies within radius of center (grid lookup,
+    // not a scan), for the getObject accessors
+    void queryObjects(const glm::vec3 &center, float radius, std::vector<uint32_t> &result) const;
+    // Procedural grass over the terrain (see GrassField); needs a loaded heightmap, so not
+    // streamed terrain, and OpenGL 4.3
+    bool setGrass(const GrassSettings &settings);
+    // grassShader: shaders/grass.vs / grass.fs with the light and wind uniforms set, wind the same
+    // vector as its wind uniform
+    void renderGrass(Shader &grassShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition, const glm::vec2 &wind);
+    size_t getObjectCount() const { return objects.size(); }
+    const glm::vec3 &getObjectPosition(uint32_t index) const { return objects.positions[index]; }
+    const std::string &getObjectType(uint32_t index) const {
+        return objectTypes[objectBatches[objects.batches[index]].typeId].name;
+    }
 
 private:
+    friend class TerrainStreamer; // Meshes tiles with the same packed vertices and strips
+    friend class TerrainCache;    // Cooks and restores the loaded state
+    friend class GpuObjectCuller; // Uploads the placed objects and their LOD levels
+    friend class GrassField;      // Reads the height textures and the pyramid's tile ranges
+
     bool loadHeightmap(const std::string &path);
+    bool loadImageHeightmap(const std::string &path);
+    bool loadRawHeightmap(const std::string &path, int bits);
+    bool generateHeightmap(const std::string &spec);
+    void computeChunkBounds();
     void setupTerrainBuffers();
+    void deleteTerrainBuffers();
+    void setupHeightTexture();
+    void uploadHeightTexture(bool respecify);
+    void bakeNormals();
+    // Bring everything derived from the heights up to date over samples [x0, x1) x [z0, z1)
+    void updateRegion(int x0, int z0, int x1, int z1);
+    void uploadNormalTexture();
+    void setupGridPatch();
+    void renderLod(Shader &shader, const Frustum &frustum, const glm::vec3 &cameraPosition);
+    void renderDisplaced(Shader &shader, const Frustum &frustum);
+    void drawPatchInstances();
 
-    // For culling
-    bool isInsideFrustum(const glm::vec4 planes[6]) const; // New method
-
-    unsigned char *heightmapData;
-    int heightmapWidth, heightmapHeight;
+    std::vector<float> heightmapData; // Row-major, normalized to [0, 1]
+    std::vector<float> pristineHeights; // heightmapData before the first deform, empty until then
+    int heightmapWidth = 0, heightmapHeight = 0;
+    int heightmapBits = 16;           // Precision of the source: 16 (images, .r16) or 32 (.f32)
 
     int terrainWidth, terrainHeight;
     float terrainScale;
 
-    GLuint terrainVAO, terrainVBO, terrainEBO;
+    GLuint terrainVAO = 0, terrainVBO = 0, terrainEBO = 0; // Only created in Mesh mode
     GLuint textureID;
+    TerrainMaterial material;
 
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<float> texCoords;
+    // Packed Mesh mode vertex, 8 bytes. Texture coordinates follow from the grid position.
+    struct TerrainVertex {
+        GLubyte x, z;    // Grid position relative to the chunk origin
+        GLushort height; // Height quantized over [0, terrainScale]
+        GLuint normal;   // 10:10:10:2, each component biased from [-1, 1] to [0, 1]
+    };
+    static void appendGridStrips(std::vector<GLushort> &stripIndices, int quadsX, int quadsZ);
+    // Attribute layout of TerrainVertex plus the per-chunk origin, on the bound VAO
+    static void setupPackedVertexLayout(GLuint vertexBuffer, GLuint chunkOriginBuffer);
+    TerrainVertex makeVertex(int x, int z, int chunkX, int chunkZ) const;
+    // Create the Mesh mode buffers from any source: the staged vectors or a cooked file
+    void uploadTerrainMesh(const TerrainVertex *vertexData, size_t vertexCount, const GLushort *indexData,
+                           size_t indexCount);
+
+    // CPU staging for the Mesh mode buffers, released once uploaded
+    std::vector<TerrainVertex> vertices;
+    std::vector<GLushort> indices; // Chunk-local strips, shared by chunks of equal size
+    GLuint chunkOriginVBO = 0;  // Per-chunk origin, fed as an instanced attribute
+    GLuint indirectBuffer = 0;  // Draw commands of the visible chunks, rebuilt every frame
 
     glm::vec3 minCorner; // Minimum point of the terrain AABB
     glm::vec3 maxCorner; // Maximum point of the terrain AABB
 
-    struct ObjectInstance {
-        glm::vec3 position;
-        int modelIndex; // Index into the model list for the type
-        std::string type;
-        float rotationY; // Y-axis rotation
-        float scale;     // Scaling factor
+    struct TerrainChunk {
+        glm::vec3 minCorner; // Tight AABB of the chunk
+        glm::vec3 maxCorner;
+        GLuint indexOffset;  // First index of the chunk's strips inside terrainEBO
+        GLsizei indexCount;  // Number of indices in the chunk's strips
+        GLint baseVertex;    // First vertex of the chunk inside terrainVBO
+    };
+    std::vector<TerrainChunk> chunks; // Row-major
+
+    // Matches the layout glMultiDrawElementsIndirect reads
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+    std::vector<DrawElementsIndirectCommand> drawCommands;
+
+    TerrainRenderMode renderMode = TerrainRenderMode::Mesh;
+    GLuint heightTextureID = 0; // Heightmap as a single-channel texture, sampled by the GPU-displaced modes
+
+    // Sobel normals per heightmap texel, rebaked whenever the heights change
+    std::vector<GLuint> normalData; // Packed like TerrainVertex::normal
+    GLuint normalTextureID = 0;     // Same data as a GL_RGB10_A2 texture
+
+    // CDLOD and Displaced: one shared grid patch, instanced once per selected node
+    std::unique_ptr<TerrainQuadtree> quadtree;
+    std::vector<TerrainQuadtree::SelectedNode> selectedNodes;
+    // Set when heights come from a tile directory; the single-heightmap data then stays empty
+    std::unique_ptr<TerrainStreamer> streamer;
+    // Min/max heights over heightmapData for ray casts, rebuilt with the heights
+    std::unique_ptr<HeightPyramid> heightPyramid;
+    // Hides objects behind hills in renderObjects; rebuilt from the pyramid every frame
+    HorizonCuller horizonCuller;
+    std::vector<float> horizonLimits, horizonBands; // rasterizeBands output for the GPU object culler
+
+    GLuint patchVAO = 0, patchVBO = 0, patchEBO = 0, nodeInstanceVBO = 0;
+    GLsizei patchIndexCount = 0;
+
+    // Lower levels of detail for the models of a type, in model order
+    struct ObjectLod {
+        float simplifiedDistance = 0.0f, impostorDistance = 0.0f;
+        std::vector<Model> simplified;
+        std::vector<std::unique_ptr<Impostor>> impostors;
+    };
+    // Models of a type name, interned by addModel; everything per object refers to it by index
+    struct ObjectType {
+        std::string name;
+        std::vector<Model> models;
+        std::vector<int> modelBatches; // objectBatches index per model, -1 until one is placed
+        bool blended = false;
+        bool hasLod = false;
+        float sway = 0.0f;
+        ObjectLod lod;
+    };
+    // Objects sharing a model, drawn with one instanced call per mesh
+    struct ObjectBatch {
+        uint16_t typeId, modelIndex;
+        std::vector<glm::mat4> transforms; // Visible matrices, refilled every frame
+        bool blended;
+        uint64_t stateKey;              // DrawSort::stateKey of the model's texture and the batch
+        float footprintRadius;          // Model-space circle any Y rotation stays inside
+        float bottom, top;              // Model-space height range
+        std::vector<glm::mat4> simplifiedTransforms;
+        std::vector<ImpostorInstance> impostorInstances;
+    };
+    // Placed objects as parallel arrays, one entry per object in each. Culling and drawing walk
+    // only the arrays they read, and the arrays upload as they are.
+    struct ObjectInstances {
+        std::vector<glm::vec3> positions;
+        std::vector<float> rotations; // About Y, in radians
+        std::vector<float> scales;
+        std::vector<uint16_t> batches; // Index into objectBatches, which gives type and model
+        // Derived from the above by updateObjectTransforms
+        std::vector<glm::mat4> transforms;
+        std::vector<glm::vec3> boundsMin, boundsMax; // World box enclosing the model at any Y rotation
+        size_t size() const { return positions.size(); }
+        bool empty() const { return positions.empty(); }
     };
-    std::vector<ObjectInstance> objects;                        // Store all placed objects
-    std::unordered_map<std::string, std::vector<Model>> models; // Store models for each type
+    // Id of an interned type name, -1 if addModel never saw it
+    int findObjectType(const std::string &type) const;
+    // Batch of a type's model, created on first use
+    uint16_t getObjectBatch(uint16_t typeId, uint16_t modelIndex);
+    // Matrices and bounds of objects [first, last) from their position, rotation and scale
+    void updateObjectTransforms(size_t first, size_t last);
+    // Put the objects standing on samples [x0, x1) x [z0, z1) back on the ground after a height change
+    void reseatObjects(int x0, int z0, int x1, int z1);
+    // Queue an object of a LOD batch at the level(s) its distance selects
+    void addLodInstance(ObjectBatch &batch, uint32_t object, float distance);
+    std::vector<ObjectType> objectTypes;
+    std::unordered_map<std::string, uint16_t> objectTypeIds; // Only consulted outside the frame loop
+    ObjectInstances objects;
+    std::vector<ObjectBatch> objectBatches;
+    ObjectGrid objectGrid;                                      // Indices into objects, by position
+    std::vector<const ObjectGrid::Cell *> visibleObjectCells;   // Scratch for renderObjects
+    std::vector<uint32_t> opaqueBatchOrder;                     // Opaque batches by stateKey
+    bool hasBlendedObjects = false;
+    // GPU-driven path for the opaque objects, rebuilt on the next render after objects or LODs change;
+    // null without OpenGL 4.3, which leaves everything on the CPU path
+    std::unique_ptr<GpuObjectCuller> gpuCuller;
+    bool gpuCullerDirty = true;
+    std::vector<uint64_t> blendedObjectKeys, sortScratch;       // Back-to-front keys of visible blended objects
+    std::unique_ptr<GrassField> grassField;
 };
 
 #endif // TERRAIN_H
@@ -0,0 +1,30 @@
+#ifndef TERRAIN_CACHE_H
+#define TERRAIN_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+class Terrain;
+
+// Directory cooked terrain files are written to, one file per key
+const char *const TERRAIN_CACHE_DIRECTORY = "cache";
+
+// Cooked terrain: the decoded heights, baked normals, chunk bounds, min/max pyramid and,
+// for the Mesh mode, the GPU-ready vertex and index blobs in one flat file. A hit maps
+// the file and hands the blobs straight to OpenGL, skipping decoding, baking and meshing.
+// Files are keyed by a hash of the source bytes and every parameter that shapes the
+// result, so a changed heightmap or setting simply misses and cooks a new file.
+class TerrainCache {
+public:
+    // False if the source cannot be read (missing file); there is nothing to key then
+    static bool computeKey(const std::string &heightmapPath, float scale, int width, int height, bool withMesh,
+                           uint64_t &key);
+    static std::string pathFor(uint64_t key);
+
+    // Fill the terrain from a cooked file; false on a miss or a stale/damaged file
+    static bool load(Terrain &terrain, uint64_t key, bool withMesh);
+    // Cook the terrain's current state. The mesh is included if it is still staged on the CPU.
+    static bool save(const Terrain &terrain, uint64_t key);
+};
+
+#endif // TERRAIN_CACHE_H
@@ -0,0 +1,40 @@
+#ifndef TERRAIN_GENERATOR_H
+#define TERRAIN_GENERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Prefix of a heightmap path that selects the generator, e.g. "procedural:seed=7,erosion=40"
+const char *const TERRAIN_PROCEDURAL_PREFIX = "procedural:";
+
+struct TerrainGeneratorSettings {
+    uint32_t seed = 1;
+    int width = 0, height = 0;   // Samples; 0 takes the terrain size
+    float frequency = 1.0f / 128.0f; // Of the first octave, in cycles per sample
+    int octaves = 6;
+    float lacunarity = 2.0f;
+    float gain = 0.5f;
+    float ridged = 0.5f;         // Blend from plain fBm (0) to ridged noise (1)
+    float warp = 24.0f;          // Domain warp offset in samples, 0 to disable
+    int erosion = 0;             // Thermal erosion iterations
+    float talus = 0.004f;        // Normalized height difference per sample that starts to slide
+};
+
+// Seeded procedural heightfields: fBm / ridged gradient noise with domain warping and an
+// optional thermal erosion pass. Noise is filled in tiles pulled by all cores and erosion
+// runs in row bands; every sample is computed from the previous state only, so the result
+// depends on the seed alone, never on the thread count.
+class TerrainGenerator {
+public:
+    // Read "key=value,..." after TERRAIN_PROCEDURAL_PREFIX; unknown keys are reported and fail
+    static bool parse(const std::string &spec, TerrainGeneratorSettings &settings);
+    // Fill heights with settings.width x settings.height samples normalized to [0, 1]
+    static void generate(const TerrainGeneratorSettings &settings, std::vector<float> &heights);
+
+private:
+    static float sample(const TerrainGeneratorSettings &settings, float x, float z);
+    static void erode(const TerrainGeneratorSettings &settings, std::vector<float> &heights);
+};
+
+#endif // TERRAIN_GENERATOR_H
@@ -0,0 +1,47 @@
+#ifndef TERRAIN_MATERIAL_H
+#define TERRAIN_MATERIAL_H
+
+#include "shader.h"
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Layers the splat shader blends; matches the uniform arrays in terrain_test.fs
+const int TERRAIN_MAX_SPLAT_LAYERS = 8;
+
+// One texture of the splat material and where it shows up. Weights fade in over
+// `blend` around each bound, so neighbouring layers overlap instead of cutting hard.
+struct TerrainLayer {
+    std::string texturePath;
+    glm::vec2 heightRange = glm::vec2(0.0f, 1.0f);  // Normalized terrain height
+    glm::vec2 slopeRange = glm::vec2(0.0f, 100.0f); // Rise over run (1 = 45 degrees)
+    float blend = 0.1f;
+};
+
+// Terrain layers packed into one GL_TEXTURE_2D_ARRAY and blended in a single fragment
+// pass, so adding layers costs neither binds nor draws. Weights come from height and
+// slope, or from a baked RGBA weight map (one channel per layer, first four layers).
+class TerrainMaterial {
+public:
+    TerrainMaterial() = default;
+    ~TerrainMaterial();
+    TerrainMaterial(const TerrainMaterial &) = delete;
+    TerrainMaterial &operator=(const TerrainMaterial &) = delete;
+
+    // Every layer is resampled to the size of the first one
+    bool load(const std::vector<TerrainLayer> &layers);
+    // Optional: weights painted or baked offline, stretched over the whole terrain
+    bool loadWeightMap(const std::string &path);
+
+    bool isLoaded() const { return arrayTexture != 0; }
+    // Bind the array (and weight map) to `unit` (and `unit + 1`) and set the splat uniforms
+    void bind(Shader &shader, int unit) const;
+
+private:
+    GLuint arrayTexture = 0;
+    GLuint weightTexture = 0;
+    std::vector<TerrainLayer> layers;
+};
+
+#endif // TERRAIN_MATERIAL_H
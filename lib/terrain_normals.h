@@ -0,0 +1,32 @@
+#ifndef TERRAIN_NORMALS_H
+#define TERRAIN_NORMALS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Bakes per-texel heightfield normals with a 3x3 Sobel filter. Rows are split across
+// threads and each row is filtered four texels at a time with SSE2 where available.
+// Normals are packed 10:10:10:2, each component biased from [-1, 1] to [0, 1], which
+// is the layout of the terrain vertex normals and of a GL_RGB10_A2 texture.
+class TerrainNormals {
+public:
+    // heights: row-major samples in [0, 1]; heightScale: world height of a sample of 1.
+    // Grid spacing is one world unit per texel.
+    static void bake(const float *heights, int width, int height, float heightScale,
+                     std::vector<GLuint> &packedNormals);
+
+    // Rebake only texels [x0, x1) x [z0, z1) of an existing bake, after the heights there
+    // (or within one texel of it) changed. Scalar; meant for small edited regions.
+    static void bakeRegion(const float *heights, int width, int height, float heightScale,
+                           int x0, int z0, int x1, int z1, GLuint *packedNormals);
+
+    static GLuint pack(const glm::vec3 &normal);
+    static glm::vec3 unpack(GLuint packed);
+
+private:
+    static void bakeRows(const float *heights, int width, int height, float sampleScale,
+                         int rowBegin, int rowEnd, GLuint *packedNormals);
+};
+
+#endif // TERRAIN_NORMALS_H
@@ -0,0 +1,57 @@
+#ifndef TERRAIN_QUADTREE_H
+#define TERRAIN_QUADTREE_H
+
+#include "frustum.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+class Terrain;
+
+// Maximum number of LOD levels the CDLOD shader keeps morph constants for
+const int CDLOD_MAX_LEVELS = 12;
+
+// Quadtree over the heightmap used for CDLOD (continuous distance-dependent LOD).
+// Every node is drawn with the same grid patch, scaled to the node size, so a node
+// one level up covers four times the area with the same triangle count.
+class TerrainQuadtree {
+public:
+    struct SelectedNode {
+        glm::vec2 offset; // World-space XZ of the node's min corner
+        float size;       // World-space side length of the node
+        float lodLevel;   // 0 = finest
+    };
+
+    // leafSize: side length of the finest nodes in world units (one quad per unit at LOD 0)
+    TerrainQuadtree(const Terrain &terrain, int leafSize, float baseRange, float morphStartRatio = 0.66f);
+
+    // Refresh node height bounds over grid vertices [x0, x1) x [z0, z1) after the terrain changed there
+    void updateHeights(const Terrain &terrain, int x0, int z0, int x1, int z1);
+
+    // Fill `selection` with the nodes to draw this frame
+    void select(const glm::vec3 &cameraPosition, const Frustum &frustum, std::vector<SelectedNode> &selection) const;
+
+    int getLevelCount() const { return levelCount; }
+    int getLeafSize() const { return leafSize; }
+    // Distance at which morphing towards the next coarser level starts/ends, per level
+    glm::vec2 getMorphRange(int level) const { return morphRanges[level]; }
+
+private:
+    struct Level {
+        int nodesX, nodesZ;                 // Node grid dimensions on this level
+        std::vector<glm::vec2> heightRange; // (min, max) height per node, row-major
+    };
+
+    bool selectNode(int level, int nodeX, int nodeZ, const glm::vec3 &cameraPosition,
+                    const Frustum &frustum, std::vector<SelectedNode> &selection) const;
+    void getNodeBounds(int level, int nodeX, int nodeZ, glm::vec3 &boxMin, glm::vec3 &boxMax) const;
+    static bool boxIntersectsSphere(const glm::vec3 &boxMin, const glm::vec3 &boxMax, const glm::vec3 &center, float radius);
+
+    int leafSize;
+    int levelCount;
+    float extentX, extentZ;              // World-space extents of the terrain grid
+    std::vector<Level> levels;           // levels[0] holds the leaves, levels.back() the root
+    std::vector<float> lodRanges;        // Max view distance per level
+    std::vector<glm::vec2> morphRanges;  // (start, end) morph distances per level
+};
+
+#endif // TERRAIN_QUADTREE_H
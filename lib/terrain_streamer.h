@@ -0,0 +1,108 @@
+#ifndef TERRAIN_STREAMER_H
+#define TERRAIN_STREAMER_H
+
+#include "frustum.h"
+#include "shader.h"
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Name of the manifest a tile directory is recognized by
+const char *const TERRAIN_TILE_MANIFEST = "tiles.txt";
+// Samples stored around every tile beyond its own grid, so normals match across tile edges
+const int TERRAIN_TILE_APRON = 1;
+// Loads of a tile before it is given up on, and the wait between them
+const int TERRAIN_TILE_LOAD_ATTEMPTS = 5;
+const int TERRAIN_TILE_RETRY_MS = 1000;
+
+struct TerrainStreamSettings {
+    int loadRadius = 2;                      // Tiles kept resident around the focus tile, per axis
+    size_t memoryBudget = (size_t)256 << 20; // CPU + GPU bytes of resident tiles
+    int uploadsPerFrame = 2;                 // Loaded tiles handed to the GPU per update
+    int workerCount = 2;
+};
+
+// World terrain split into square tiles on disk (tile_<x>_<z>.r16). Tiles around a focus
+// point are loaded and meshed on worker threads and uploaded on the render thread a few
+// per frame; tiles outside the load radius stay cached until the memory budget is hit,
+// farthest first. The render thread never waits on disk.
+class TerrainStreamer {
+public:
+    // directory: a tile set written by bakeTiles; heightScale: world height of a sample of 1
+    TerrainStreamer(const std::string &directory, float heightScale, const TerrainStreamSettings &settings = TerrainStreamSettings());
+    ~TerrainStreamer();
+
+    // Split a heightmap (normalized samples) into tiles. tileSize must be a multiple of TERRAIN_CHUNK_SIZE.
+    static bool bakeTiles(const float *heights, int width, int height, int tileSize, const std::string &directory);
+
+    bool isValid() const { return valid; }
+    // Queue loads around the focus, upload finished tiles and evict over budget. Render thread only.
+    void update(const glm::vec3 &focus);
+    // Load time only: block until every tile in the load radius of the focus is resident
+    void waitForTiles(const glm::vec3 &focus);
+    void render(Shader &shader, const Frustum &frustum);
+
+    // False if the tile under (x, z) is not resident
+    bool getHeightAt(float x, float z, float &height) const;
+    bool getNormalAt(float x, float z, glm::vec3 &normal) const;
+
+    int getWorldWidth() const { return worldWidth; }   // In samples
+    int getWorldHeight() const { return worldHeight; }
+    int getTileSize() const { return tileSize; }
+    glm::vec2 getHeightRange() const { return heightRange * heightScale; } // World-space min/max over all tiles
+
+private:
+    struct Tile;
+    typedef std::pair<int, int> TileKey; // (tileX, tileZ)
+
+    void workerLoop();
+    std::unique_ptr<Tile> loadTile(const TileKey &key) const;
+    void uploadTile(Tile &tile);
+    void releaseTile(Tile &tile);
+    void requestTiles(const TileKey &focusTile);
+    void retryFailedTiles();
+    bool isInLoadRadius(const TileKey &key, const TileKey &focusTile) const;
+    TileKey tileAt(float x, float z) const;
+    const Tile *residentTileAt(float x, float z, float &localX, float &localZ) const;
+    std::string tilePath(const TileKey &key) const;
+
+    bool valid = false;
+    std::string directory;
+    float heightScale;
+    TerrainStreamSettings settings;
+    int tileSize = 0, tilesX = 0, tilesZ = 0;
+    int worldWidth = 0, worldHeight = 0;
+    glm::vec2 heightRange = glm::vec2(0.0f); // Normalized, from the manifest
+
+    // Render thread only
+    std::map<TileKey, std::unique_ptr<Tile>> residentTiles;
+    std::set<TileKey> inFlight; // Queued or being loaded
+    std::map<TileKey, int> failedTiles; // Failed loads per tile, retried up to TERRAIN_TILE_LOAD_ATTEMPTS
+    std::chrono::steady_clock::time_point nextRetry;
+    TileKey focusTile = TileKey(-1, -1);
+    size_t residentBytes = 0;
+    bool budgetWarningShown = false;
+    GLuint chunkEBO = 0;        // Strips of one chunk, shared by every tile
+    GLsizei chunkIndexCount = 0;
+    GLuint indirectBuffer = 0;
+
+    // Shared with the workers
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<TileKey> requests;                  // Nearest first
+    std::deque<std::unique_ptr<Tile>> completed;   // Loaded, waiting for upload
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+#endif // TERRAIN_STREAMER_H
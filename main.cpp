@@ -24,6 +24,15 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// CDLOD keeps the terrain triangle count flat on large heightmaps; Displaced keeps no per-vertex heights in memory
+const TerrainRenderMode TERRAIN_RENDER_MODE = TerrainRenderMode::Mesh;
+// A heightmap file, a directory of tiles baked with Terrain::bakeTiles for worlds too large to load at once,
+// or a generator spec such as "procedural:seed=7,erosion=40"
+const char *TERRAIN_HEIGHTMAP = "images/height-map.png";
+// Set to a directory to split the heightmap above into streamable tiles there on start-up;
+// point TERRAIN_HEIGHTMAP at that directory afterwards
+const char *TERRAIN_BAKE_DIRECTORY = nullptr;
+const int TERRAIN_BAKE_TILE_SIZE = 256; // A multiple of TERRAIN_CHUNK_SIZE
 
 // camera
 Camera *camera = new Camera(glm::vec3(0.0f, 5.0f, 10.0f)); // Example initial position for the camera
@@ -40,6 +49,7 @@ float lastY = SCR_HEIGHT / 2.0f;
 glm::vec3 cameraOffset(0.0f, 3.0f, 10.0f);  // Adjust for desired fixed distance and height
 glm::vec3 lightPos(100.0f, 100.0f, 100.0f); // Position of light source
 glm::vec3 lightColor(1.0f, 1.0f, 1.0f);     // Light color (white light)
+glm::vec2 windVector(0.8f, 0.3f);            // Wind over the vegetation: xz direction scaled by strength (up to about 1)
 
 int main() {
 
@@ -86,7 +96,16 @@ int main() {
     // build and compile shaders
     // -------------------------
     Shader playerShader("shaders/model.vs", "shaders/model.fs");
-    Shader terrainShader("shaders/terrain_test.vs", "shaders/terrain_test.fs");
+    Shader objectShader("shaders/model_instanced.vs", "shaders/model_instanced.fs");
+    Shader impostorShader("shaders/impostor.vs", "shaders/impostor.fs");
+    Shader grassShader("shaders/grass.vs", "shaders/grass.fs");
+    const char *terrainVertexShader = "shaders/terrain_test.vs";
+    if (TERRAIN_RENDER_MODE == TerrainRenderMode::CDLOD) {
+        terrainVertexShader = "shaders/terrain_cdlod.vs";
+    } else if (TERRAIN_RENDER_MODE == TerrainRenderMode::Displaced) {
+        terrainVertexShader = "shaders/terrain_displaced.vs";
+    }
+    Shader terrainShader(terrainVertexShader, "shaders/terrain_test.fs");
     Shader collectibleShader("shaders/collectible.vs", "shaders/collectible.fs");
     Shader overlayShader("shaders/overlay.vs", "shaders/overlay.fs");
     cout << "Shaders compiled!" << endl;
@@ -103,7 +122,13 @@ int main() {
     cout << "Sound manager initialized!" << endl;
 
     // Initialize terrain
-    terrain = new Terrain("images/height-map.png", 5.0f, 256, 256);
+    terrain = new Terrain(TERRAIN_HEIGHTMAP, 5.0f, 256, 256, TERRAIN_RENDER_MODE);
+    if (TERRAIN_BAKE_DIRECTORY && !terrain->isStreamed()) {
+        terrain->bakeTiles(TERRAIN_BAKE_DIRECTORY, TERRAIN_BAKE_TILE_SIZE);
+    }
+#ifdef TERRAIN_BENCHMARK
+    terrain->benchmarkHeightQueries(1 << 22);
+#endif
     // Initialize player
     player = new Model(FileSystem::getPath("models/oiiaioooooiai_cat/oiiaioooooiai_cat.obj"));
 
@@ -182,6 +207,7 @@ int main() {
 
         // Update game state
         gameController.update();
+        terrain->updateStreaming(player->GetPosition()); // No-op unless the terrain is streamed from tiles
 
         // Rendering
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -219,6 +245,14 @@ int main() {
         collectibleShader.use();
         collectibleManager.renderAll(collectibleShader, vp);
 
+        // Wind: the vegetation shaders animate from these alone
+        float windTime = (float)glfwGetTime();
+        for (Shader *shader : {&objectShader, &impostorShader, &grassShader}) {
+            shader->use();
+            shader->setFloat("time", windTime);
+            shader->setVec2("wind", windVector);
+        }
+
         // ** Render terrain **
         terrainShader.use();
         terrainShader.setMat4("view", view);
@@ -228,10 +262,14 @@ int main() {
         terrainShader.setVec3("lightColor", lightColor);
         glm::mat4 terrainModel = glm::mat4(1.0f); // Identity matrix for no transformation
         terrainShader.setMat4("model", terrainModel);
-        terrain->render(terrainShader, vp); // Render the terrain
+        terrain->render(terrainShader, vp, camera->Position); // Render the terrain
+        grassShader.use();
+        grassShader.setVec3("lightPos", lightPos);
+        grassShader.setVec3("lightColor", lightColor);
+        terrain->renderGrass(grassShader, vp, camera->Position, windVector);
 
         // ** Render objects **
-        terrain->renderObjects(playerShader, vp, camera->Position);
+        terrain->renderObjects(objectShader, impostorShader, vp, camera->Position);
         // Render the scoreboard
         std::string scoreText = "Score: " + std::to_string(gameController.getCollectedCount()) + "/" + std::to_string(collectibleManager.getTotalCount());
         textRenderer.RenderText(textShader, scoreText, SCR_WIDTH - 175.0f, SCR_HEIGHT - 50.0f, 1.0f, glm::vec3(1.0f, 1.0f, 1.0f)); // Top-right corner
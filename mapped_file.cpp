@@ -0,0 +1,108 @@
+#include "lib/mapped_file.h"
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string &path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open file: " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        std::cerr << "Cannot map empty file: " << path << std::endl;
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        std::cerr << "Failed to map file: " << path << std::endl;
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedData = view;
+    mappedSize = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open file: " << path << std::endl;
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        std::cerr << "Cannot map empty file: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void *view = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps its own reference to the file
+    if (view == MAP_FAILED) {
+        std::cerr << "Failed to map file: " << path << std::endl;
+        return false;
+    }
+    madvise(view, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+    mappedData = view;
+    mappedSize = (size_t)fileStat.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::release(size_t offset, size_t length) {
+    if (!mappedData || offset >= mappedSize) {
+        return;
+    }
+    length = std::min(length, mappedSize - offset);
+#ifdef _WIN32
+    // Clean file pages of a view cannot be dropped one range at a time; the working set
+    // trimmer reclaims them first under memory pressure
+    (void)length;
+#else
+    // Whole pages inside the range only
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t first = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t last = offset + length == mappedSize ? mappedSize : (offset + length) / pageSize * pageSize;
+    if (last > first) {
+        madvise(static_cast<char *>(const_cast<void *>(mappedData)) + first, last - first, MADV_DONTNEED);
+    }
+#endif
+}
+
+void MappedFile::close() {
+    if (!mappedData) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mappedData);
+    CloseHandle((HANDLE)mappingHandle);
+    CloseHandle((HANDLE)fileHandle);
+    fileHandle = mappingHandle = nullptr;
+#else
+    munmap(const_cast<void *>(mappedData), mappedSize);
+#endif
+    mappedData = nullptr;
+    mappedSize = 0;
+}
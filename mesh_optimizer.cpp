@@ -0,0 +1,371 @@
+#include "lib/mesh_optimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Forsyth scoring parameters; the cache modelled for scoring is larger than the one reported
+const int kCacheSize = 32;
+const float kCacheDecayPower = 1.5f;
+const float kLastTriScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+
+float vertexScore(int cachePosition, int remainingValence) {
+    if (remainingValence == 0) {
+        return -1.0f; // No triangles left to use this vertex
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            score = kLastTriScore; // Used by the last triangle: fixed score to avoid favouring one order
+        } else {
+            float scaler = 1.0f / (kCacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+        }
+    }
+    // Prefer vertices with few triangles left so they can leave the cache for good
+    score += kValenceBoostScale * std::pow((float)remainingValence, -kValenceBoostPower);
+    return score;
+}
+
+struct VertexHash {
+    size_t operator()(const Vertex &vertex) const {
+        // FNV-1a over the raw bytes; Vertex is plain floats with no padding
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&vertex);
+        size_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(Vertex); ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+};
+
+struct VertexEqual {
+    bool operator()(const Vertex &a, const Vertex &b) const {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+} // namespace
+
+void MeshOptimizer::Stats::add(const Stats &other) {
+    size_t total = triangles + other.triangles;
+    if (total > 0) {
+        acmrBefore = (acmrBefore * triangles + other.acmrBefore * other.triangles) / total;
+        acmrAfter = (acmrAfter * triangles + other.acmrAfter * other.triangles) / total;
+    }
+    verticesBefore += other.verticesBefore;
+    verticesAfter += other.verticesAfter;
+    triangles = total;
+}
+
+MeshOptimizer::Stats MeshOptimizer::optimize(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, bool optimizeOverdraw) {
+    Stats stats;
+    stats.verticesBefore = vertices.size();
+    stats.triangles = indices.size() / 3;
+    stats.acmrBefore = computeACMR(indices.data(), indices.size(), stats.triangles, vertices.size());
+
+    // Only plain triangle lists are handled; leave anything else untouched
+    if (indices.empty() || indices.size() % 3 != 0) {
+        stats.verticesAfter = vertices.size();
+        stats.acmrAfter = stats.acmrBefore;
+        return stats;
+    }
+
+    weldVertices(vertices, indices);
+    optimizeVertexCache(indices, vertices.size());
+    if (optimizeOverdraw) {
+        MeshOptimizer::optimizeOverdraw(indices, vertices);
+    }
+    optimizeVertexFetch(vertices, indices);
+
+    stats.verticesAfter = vertices.size();
+    stats.acmrAfter = computeACMR(indices.data(), indices.size(), stats.triangles, vertices.size());
+    return stats;
+}
+
+size_t MeshOptimizer::weldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique;
+    unique.reserve(vertices.size());
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        auto inserted = unique.emplace(vertices[i], (unsigned int)welded.size());
+        if (inserted.second) {
+            welded.push_back(vertices[i]);
+        }
+        remap[i] = inserted.first->second;
+    }
+    for (auto &index : indices) {
+        index = remap[index];
+    }
+    vertices.swap(welded);
+    return vertices.size();
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Vertex -> triangles adjacency in one flat array
+    std::vector<int> valence(vertexCount, 0);
+    for (unsigned int index : indices) {
+        ++valence[index];
+    }
+    std::vector<size_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adjacencyStart[v + 1] = adjacencyStart[v] + valence[v];
+    }
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<int> remaining(vertexCount, 0); // Triangles not yet emitted, kept at the front of the vertex's list
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = indices[t * 3 + k];
+            adjacency[adjacencyStart[v] + remaining[v]++] = (unsigned int)t;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        score[v] = vertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(kCacheSize + 3);
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    size_t scanPosition = 0; // Fallback scan for when no cached vertex has triangles left
+    int bestTriangle = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (bestTriangle < 0) {
+            while (emitted[scanPosition]) {
+                ++scanPosition;
+            }
+            bestTriangle = (int)scanPosition;
+        }
+
+        // Emit the triangle and push its vertices to the front of the LRU cache
+        emitted[bestTriangle] = true;
+        newCache.clear();
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = indices[bestTriangle * 3 + k];
+            output.push_back(v);
+            newCache.push_back(v);
+
+            // Drop the triangle from the vertex's remaining list
+            unsigned int *list = &adjacency[adjacencyStart[v]];
+            for (int i = 0; i < remaining[v]; ++i) {
+                if (list[i] == (unsigned int)bestTriangle) {
+                    std::swap(list[i], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            --remaining[v];
+        }
+        for (unsigned int v : cache) {
+            if (std::find(newCache.begin(), newCache.begin() + 3, v) == newCache.begin() + 3) {
+                newCache.push_back(v);
+            }
+        }
+
+        // Rescore everything that was or is in the cache and pick the best triangle among their neighbours
+        for (unsigned int v : cache) {
+            cachePosition[v] = -1;
+        }
+        for (size_t i = 0; i < newCache.size(); ++i) {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < (size_t)kCacheSize ? (int)i : -1;
+        }
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : newCache) {
+            float newScore = vertexScore(cachePosition[v], remaining[v]);
+            float delta = newScore - score[v];
+            score[v] = newScore;
+            for (int i = 0; i < remaining[v]; ++i) {
+                unsigned int t = adjacency[adjacencyStart[v] + i];
+                triangleScore[t] += delta;
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    bestTriangle = (int)t;
+                }
+            }
+        }
+
+        if (newCache.size() > (size_t)kCacheSize) {
+            newCache.resize(kCacheSize);
+        }
+        cache.swap(newCache);
+    }
+
+    indices.swap(output);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Clusters start where a triangle misses on all three vertices: the cache was flushed there anyway,
+    // so reordering whole clusters costs (almost) nothing in ACMR
+    std::vector<size_t> clusterStarts;
+    std::vector<size_t> insertedAt(vertices.size(), 0);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = indices[t * 3 + k];
+            if (insertedAt[v] == 0 || misses - insertedAt[v] >= (size_t)MESH_OPTIMIZER_REPORT_CACHE) {
+                ++misses;
+                insertedAt[v] = misses;
+                ++triangleMisses;
+            }
+        }
+        if (triangleMisses == 3 || t == 0) {
+            clusterStarts.push_back(t);
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+
+    glm::vec3 meshCentroid(0.0f);
+    for (const auto &vertex : vertices) {
+        meshCentroid += vertex.Position;
+    }
+    meshCentroid /= (float)std::max<size_t>(vertices.size(), 1);
+
+    // Clusters facing away from the mesh centre are likely in front: draw them first
+    struct Cluster {
+        size_t start, end;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c + 1 < clusterStarts.size(); ++c) {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+            const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0); // Length is twice the area
+            float faceArea = glm::length(faceNormal);
+            centroid += (p0 + p1 + p2) * (faceArea / 3.0f);
+            normal += faceNormal;
+            area += faceArea;
+        }
+        if (area > 0.0f) {
+            centroid /= area;
+        }
+        float normalLength = glm::length(normal);
+        float sortKey = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+        clusters.push_back({clusterStarts[c], clusterStarts[c + 1], sortKey});
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const auto &cluster : clusters) {
+        output.insert(output.end(), indices.begin() + cluster.start * 3, indices.begin() + cluster.end * 3);
+    }
+    indices.swap(output);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+    for (auto &index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = (unsigned int)ordered.size();
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered); // Unreferenced vertices are dropped
+}
+
+size_t MeshOptimizer::simplifyClusters(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, float cellSize) {
+    if (vertices.empty() || cellSize <= 0.0f) {
+        return indices.size() / 3;
+    }
+    glm::vec3 origin = vertices[0].Position;
+    for (const auto &vertex : vertices) {
+        origin = glm::min(origin, vertex.Position);
+    }
+
+    // Cell of every vertex, and the mean position of every cell
+    std::unordered_map<uint64_t, unsigned int> cellIds;
+    std::vector<unsigned int> cellOf(vertices.size());
+    std::vector<glm::vec3> cellSum;
+    std::vector<int> cellCount;
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        glm::vec3 cell = glm::floor((vertices[i].Position - origin) / cellSize);
+        uint64_t key = ((uint64_t)cell.x << 42) | ((uint64_t)cell.y << 21) | (uint64_t)cell.z;
+        auto inserted = cellIds.emplace(key, (unsigned int)cellSum.size());
+        if (inserted.second) {
+            cellSum.push_back(glm::vec3(0.0f));
+            cellCount.push_back(0);
+        }
+        cellOf[i] = inserted.first->second;
+        cellSum[cellOf[i]] += vertices[i].Position;
+        ++cellCount[cellOf[i]];
+    }
+
+    // The representative keeps a real vertex's attributes, so texture coordinates stay valid
+    std::vector<unsigned int> representative(cellSum.size(), ~0u);
+    std::vector<float> bestDistance(cellSum.size(), FLT_MAX);
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        unsigned int cell = cellOf[i];
+        glm::vec3 offset = vertices[i].Position - cellSum[cell] / (float)cellCount[cell];
+        float distance = glm::dot(offset, offset);
+        if (distance < bestDistance[cell]) {
+            bestDistance[cell] = distance;
+            representative[cell] = (unsigned int)i;
+        }
+    }
+
+    std::vector<unsigned int> simplified;
+    std::unordered_set<uint64_t> seenTriangles; // Sorted cell triple, exact below about two million cells
+    uint64_t cellTotal = cellSum.size();
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        unsigned int a = cellOf[indices[t]], b = cellOf[indices[t + 1]], c = cellOf[indices[t + 2]];
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+        unsigned int sorted[3] = {a, b, c};
+        std::sort(sorted, sorted + 3);
+        uint64_t key = (sorted[0] * cellTotal + sorted[1]) * cellTotal + sorted[2];
+        if (!seenTriangles.insert(key).second) {
+            continue;
+        }
+        simplified.push_back(representative[a]);
+        simplified.push_back(representative[b]);
+        simplified.push_back(representative[c]);
+    }
+    indices.swap(simplified);
+
+    // Drop the vertices no triangle uses any more, then restore cache and fetch order
+    optimizeVertexCache(indices, vertices.size());
+    optimizeVertexFetch(vertices, indices);
+    return indices.size() / 3;
+}
@@ -0,0 +1,113 @@
+#include "lib/object_grid.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+void ObjectGrid::reset(float width, float depth, float newCellSize) {
+    cellSize = newCellSize;
+    cellsX = std::max(1, (int)std::ceil(width / cellSize));
+    cellsZ = std::max(1, (int)std::ceil(depth / cellSize));
+    cells.assign((size_t)cellsX * cellsZ, Cell{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX), {}, {}});
+}
+
+int ObjectGrid::cellIndexX(float x) const {
+    return std::min(std::max((int)std::floor(x / cellSize), 0), cellsX - 1);
+}
+
+int ObjectGrid::cellIndexZ(float z) const {
+    return std::min(std::max((int)std::floor(z / cellSize), 0), cellsZ - 1);
+}
+
+void ObjectGrid::insert(uint32_t item, const glm::vec3 &position, const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+    Cell &cell = cells[(size_t)cellIndexZ(position.z) * cellsX + cellIndexX(position.x)];
+    cell.items.push_back(item);
+    cell.positions.push_back(position);
+    cell.boundsMin = glm::min(cell.boundsMin, boxMin);
+    cell.boundsMax = glm::max(cell.boundsMax, boxMax);
+}
+
+void ObjectGrid::setHeight(uint32_t item, const glm::vec3 &position) {
+    if (cells.empty()) {
+        return;
+    }
+    Cell &cell = cells[(size_t)cellIndexZ(position.z) * cellsX + cellIndexX(position.x)];
+    auto it = std::find(cell.items.begin(), cell.items.end(), item);
+    if (it != cell.items.end()) {
+        cell.positions[it - cell.items.begin()].y = position.y;
+    }
+}
+
+void ObjectGrid::refit(const std::vector<glm::vec3> &boxMin, const std::vector<glm::vec3> &boxMax, const glm::vec2 &minXZ,
+                       const glm::vec2 &maxXZ) {
+    if (cells.empty()) {
+        return;
+    }
+    for (int cellZ = cellIndexZ(minXZ.y); cellZ <= cellIndexZ(maxXZ.y); ++cellZ) {
+        for (int cellX = cellIndexX(minXZ.x); cellX <= cellIndexX(maxXZ.x); ++cellX) {
+            Cell &cell = cells[(size_t)cellZ * cellsX + cellX];
+            cell.boundsMin = glm::vec3(FLT_MAX);
+            cell.boundsMax = glm::vec3(-FLT_MAX);
+            for (uint32_t item : cell.items) {
+                cell.boundsMin = glm::min(cell.boundsMin, boxMin[item]);
+                cell.boundsMax = glm::max(cell.boundsMax, boxMax[item]);
+            }
+        }
+    }
+}
+
+void ObjectGrid::selectVisible(const Frustum &frustum, const glm::vec3 &eye, std::vector<const Cell *> &visible) const {
+    sortedCells.clear();
+    for (const Cell &cell : cells) {
+        if (cell.items.empty() || !frustum.intersectsBox(cell.boundsMin, cell.boundsMax)) {
+            continue;
+        }
+        float dx = std::max({cell.boundsMin.x - eye.x, 0.0f, eye.x - cell.boundsMax.x});
+        float dz = std::max({cell.boundsMin.z - eye.z, 0.0f, eye.z - cell.boundsMax.z});
+        sortedCells.push_back(std::make_pair(dx * dx + dz * dz, &cell));
+    }
+    std::sort(sortedCells.begin(), sortedCells.end(),
+              [](const std::pair<float, const Cell *> &a, const std::pair<float, const Cell *> &b) {
+                  return a.first < b.first;
+              });
+    visible.clear();
+    for (const auto &entry : sortedCells) {
+        visible.push_back(entry.second);
+    }
+}
+
+void ObjectGrid::queryRadius(const glm::vec3 &center, float radius, std::vector<uint32_t> &result) const {
+    result.clear();
+    if (cells.empty()) {
+        return;
+    }
+    float radiusSquared = radius * radius;
+    for (int cellZ = cellIndexZ(center.z - radius); cellZ <= cellIndexZ(center.z + radius); ++cellZ) {
+        for (int cellX = cellIndexX(center.x - radius); cellX <= cellIndexX(center.x + radius); ++cellX) {
+            const Cell &cell = cells[(size_t)cellZ * cellsX + cellX];
+            for (size_t i = 0; i < cell.items.size(); ++i) {
+                glm::vec3 offset = cell.positions[i] - center;
+                if (glm::dot(offset, offset) <= radiusSquared) {
+                    result.push_back(cell.items[i]);
+                }
+            }
+        }
+    }
+}
+
+void ObjectGrid::queryRect(const glm::vec2 &minXZ, const glm::vec2 &maxXZ, std::vector<uint32_t> &result) const {
+    result.clear();
+    if (cells.empty()) {
+        return;
+    }
+    for (int cellZ = cellIndexZ(minXZ.y); cellZ <= cellIndexZ(maxXZ.y); ++cellZ) {
+        for (int cellX = cellIndexX(minXZ.x); cellX <= cellIndexX(maxXZ.x); ++cellX) {
+            const Cell &cell = cells[(size_t)cellZ * cellsX + cellX];
+            for (size_t i = 0; i < cell.items.size(); ++i) {
+                const glm::vec3 &position = cell.positions[i];
+                if (position.x >= minXZ.x && position.x <= maxXZ.x && position.z >= minXZ.y && position.z <= maxXZ.y) {
+                    result.push_back(cell.items[i]);
+                }
+            }
+        }
+    }
+}
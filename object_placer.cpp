@@ -0,0 +1,168 @@
+#include "lib/object_placer.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+const int kTileCells = 32;     // Grid cells per tile side; at least 2 so concurrent tiles stay apart
+const int kDartsPerCell = 8;   // Attempts before a cell is left empty
+const int kAreaSamples = 64;   // Per side, for the valid-area estimate
+// Samples per radius squared of area that kDartsPerCell-dart sampling reaches, measured
+const float kPackingDensity = 0.70f;
+const float kOverfill = 1.04f; // Aim slightly above the count so only a few samples are dropped
+// The radius is never shrunk below this fraction of the fitted one, which bounds the grid size
+// when the area estimate is far off
+const float kMinRadiusFraction = 0.1f;
+// PCG stream ids per use, tagged in bits 61-62 (bit 63 is lost to the increment) so no two uses
+// share a stream. Disk sampling puts the attempt in bits 40 and up and the tile below.
+const uint64_t kDiskStreams = 0ull << 61, kAreaStreams = 1ull << 61, kShuffleStream = 2ull << 61;
+
+// Run body(job) for job in [0, jobs) on all cores, jobs handed out through a counter
+template <typename Body>
+void parallelFor(int jobs, const Body &body) {
+    int threadCount = std::max(1, std::min((int)std::max(1u, std::thread::hardware_concurrency()), jobs));
+    std::atomic<int> nextJob(0);
+    auto worker = [&]() {
+        for (int job = nextJob++; job < jobs; job = nextJob++) {
+            body(job);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : workers) {
+        thread.join();
+    }
+}
+
+} // namespace
+
+std::vector<glm::vec3> ObjectPlacer::sampleDisk(float width, float depth, float radius, uint64_t seed, int attempt,
+                                                const AcceptFunction &accept) {
+    float cellSize = radius / std::sqrt(2.0f);
+    int cellsX = std::max(1, (int)std::ceil(width / cellSize));
+    int cellsZ = std::max(1, (int)std::ceil(depth / cellSize));
+    std::vector<glm::vec3> cellSample((size_t)cellsX * cellsZ);
+    std::vector<char> occupied((size_t)cellsX * cellsZ, 0);
+    int tilesX = (cellsX + kTileCells - 1) / kTileCells, tilesZ = (cellsZ + kTileCells - 1) / kTileCells;
+    float radiusSquared = radius * radius;
+
+    auto sampleTile = [&](int tileX, int tileZ) {
+        Pcg32 random(seed, kDiskStreams | (uint64_t)attempt << 40 | ((uint64_t)tileZ * tilesX + tileX));
+        int cellX1 = std::min((tileX + 1) * kTileCells, cellsX), cellZ1 = std::min((tileZ + 1) * kTileCells, cellsZ);
+        for (int cellZ = tileZ * kTileCells; cellZ < cellZ1; ++cellZ) {
+            for (int cellX = tileX * kTileCells; cellX < cellX1; ++cellX) {
+                // One draw per cell, so retries do not dilute the keep probability
+                float keepDraw = random.nextFloat();
+                for (int dart = 0; dart < kDartsPerCell; ++dart) {
+                    float x = (cellX + random.nextFloat()) * cellSize, z = (cellZ + random.nextFloat()) * cellSize;
+                    if (x >= width || z >= depth) {
+                        continue;
+                    }
+                    // A conflicting sample can only be within two cells
+                    bool clear = true;
+                    for (int nz = std::max(cellZ - 2, 0); clear && nz <= std::min(cellZ + 2, cellsZ - 1); ++nz) {
+                        for (int nx = std::max(cellX - 2, 0); nx <= std::min(cellX + 2, cellsX - 1); ++nx) {
+                            size_t neighbour = (size_t)nz * cellsX + nx;
+                            if (occupied[neighbour]) {
+                                float dx = cellSample[neighbour].x - x, dz = cellSample[neighbour].z - z;
+                                if (dx * dx + dz * dz < radiusSquared) {
+                                    clear = false;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                    float height, keepProbability = 1.0f;
+                    if (!clear || !accept(x, z, height, keepProbability) || keepDraw >= keepProbability) {
+                        continue;
+                    }
+                    size_t cell = (size_t)cellZ * cellsX + cellX;
+                    cellSample[cell] = glm::vec3(x, height, z);
+                    occupied[cell] = 1;
+                    break;
+                }
+            }
+        }
+    };
+
+    for (int phase = 0; phase < 4; ++phase) {
+        int phaseX = phase & 1, phaseZ = phase >> 1;
+        int phaseTilesX = (tilesX - phaseX + 1) / 2, phaseTilesZ = (tilesZ - phaseZ + 1) / 2;
+        parallelFor(phaseTilesX * phaseTilesZ, [&](int job) {
+            sampleTile(phaseX + 2 * (job % phaseTilesX), phaseZ + 2 * (job / phaseTilesX));
+        });
+    }
+
+    std::vector<glm::vec3> samples;
+    for (size_t cell = 0; cell < occupied.size(); ++cell) {
+        if (occupied[cell]) {
+            samples.push_back(cellSample[cell]);
+        }
+    }
+    return samples;
+}
+
+std::vector<glm::vec3> ObjectPlacer::place(float width, float depth, int count, float minSpacing, uint64_t seed,
+                                           const AcceptFunction &accept) {
+    if (count <= 0 || width <= 0.0f || depth <= 0.0f) {
+        return {};
+    }
+
+    // Valid area, weighted by the keep probability, from a jittered grid of test points
+    std::vector<float> rowArea(kAreaSamples, 0.0f);
+    parallelFor(kAreaSamples, [&](int row) {
+        Pcg32 random(seed, kAreaStreams | (uint64_t)row);
+        for (int column = 0; column < kAreaSamples; ++column) {
+            float x = (column + random.nextFloat()) * width / kAreaSamples;
+            float z = (row + random.nextFloat()) * depth / kAreaSamples;
+            float height, keepProbability = 1.0f;
+            if (accept(x, z, height, keepProbability)) {
+                rowArea[row] += keepProbability;
+            }
+        }
+    });
+    float validArea = 0.0f;
+    for (float area : rowArea) {
+        validArea += area;
+    }
+    validArea *= width * depth / (kAreaSamples * kAreaSamples);
+    if (validArea <= 0.0f) {
+        std::cerr << "Object placement: no valid area for " << count << " objects" << std::endl;
+        return {};
+    }
+
+    // Shrink the radius until the count is met or the spacing allows no less; the sampling is
+    // deterministic, so each try is too
+    float fittedRadius = std::sqrt(kPackingDensity * validArea / (count * kOverfill));
+    float minRadius = std::max(minSpacing, kMinRadiusFraction * fittedRadius);
+    float radius = std::max(minSpacing, fittedRadius);
+    std::vector<glm::vec3> samples;
+    for (int attempt = 0;; ++attempt) {
+        samples = sampleDisk(width, depth, radius, seed, attempt, accept);
+        if ((int)samples.size() >= count || radius <= minRadius) {
+            break;
+        }
+        float shrink = samples.empty() ? 0.5f : std::sqrt(samples.size() / (count * kOverfill));
+        radius = std::max(minRadius, radius * std::min(shrink, 0.98f));
+    }
+
+    if ((int)samples.size() > count) {
+        // Drop the surplus at random: a partial Fisher-Yates shuffle keeps a uniform subset
+        Pcg32 random(seed, kShuffleStream);
+        for (int i = 0; i < count; ++i) {
+            int pick = i + (int)(random.next() % (uint32_t)(samples.size() - i));
+            std::swap(samples[i], samples[pick]);
+        }
+        samples.resize(count);
+    } else if ((int)samples.size() < count) {
+        std::cerr << "Object placement: only " << samples.size() << " of " << count << " objects fit at spacing "
+                  << radius << " (minimum " << minSpacing << ")" << std::endl;
+    }
+    return samples;
+}
@@ -0,0 +1,16 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec3 BladeColor;
+
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+
+void main() {
+    // Blades are seen from both sides and let light through, so the back is lit too
+    vec3 lightDir = normalize(lightPos - FragPos);
+    float diffuse = 0.35 + 0.65 * abs(dot(normalize(Normal), lightDir));
+    FragColor = vec4(BladeColor * lightColor * diffuse, 1.0);
+}
@@ -0,0 +1,86 @@
+#version 430 core
+layout(location = 0) in vec2 tileOrigin; // Per tile; the same for every blade of a draw
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec3 BladeColor;
+
+uniform mat4 viewProjection;
+uniform vec3 cameraPosition;
+
+uniform sampler2D heightMap;
+uniform sampler2D normalMap; // Same texel layout as heightMap
+uniform vec2 heightmapSize;
+uniform vec2 terrainExtent;  // World-space size of the terrain grid
+uniform float terrainScale;
+
+uniform float tileSize;
+uniform float bladesPerTile;
+uniform vec2 densityDistances; // Full density up to x, none from y
+uniform vec2 heightRange;      // World-space terrain height that grows grass
+uniform float maxSlope;        // Rise over run
+uniform vec2 bladeSize;        // Height and base width of the largest blade
+uniform float bladeSway;       // Lean of a blade tip at unit wind, as a fraction of its height
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float nextRandom(inout uint state) {
+    state = hash(state);
+    return float(state >> 8) / 16777216.0;
+}
+
+#include "wind.glsl"
+
+void main() {
+    // Position and shape from the tile and blade index, so a blade is the same every frame
+    uvec2 tile = uvec2(tileOrigin / tileSize);
+    uint state = hash(uint(gl_InstanceID) ^ hash((tile.y << 16) ^ tile.x));
+    vec2 worldXZ = tileOrigin + vec2(nextRandom(state), nextRandom(state)) * tileSize;
+    float facing = nextRandom(state) * 6.2831853;
+    float heightScale = mix(0.5, 1.0, nextRandom(state));
+    float bend = mix(0.1, 0.45, nextRandom(state));
+    float tint = mix(0.8, 1.1, nextRandom(state));
+    float stiffness = mix(0.6, 1.0, nextRandom(state));
+
+    // Texel centres sit on integer world coordinates, like in Terrain::getHeightAt
+    vec2 uv = (worldXZ + 0.5) / heightmapSize;
+    float groundHeight = textureLod(heightMap, uv, 0.0).r * terrainScale;
+    vec3 groundNormal = normalize(textureLod(normalMap, uv, 0.0).xyz * 2.0 - 1.0);
+    vec3 root = vec3(worldXZ.x, groundHeight, worldXZ.y);
+
+    // Thinning with distance: the blade goes once its rank among the tile's blades passes
+    // the density here, shrinking over the last 5% of ranks instead of popping
+    float keep = clamp((densityDistances.y - distance(cameraPosition, root)) / (densityDistances.y - densityDistances.x), 0.0, 1.0);
+    float rank = (float(gl_InstanceID) + 0.5) / bladesPerTile;
+    float size = clamp((keep - rank) * 20.0, 0.0, 1.0);
+    float slope = length(groundNormal.xz) / max(groundNormal.y, 1e-3);
+    if (groundHeight < heightRange.x || groundHeight > heightRange.y || slope > maxSlope ||
+        any(greaterThan(worldXZ, terrainExtent))) {
+        size = 0.0; // Every vertex on the root: a degenerate strip, nothing is rasterized
+    }
+
+    // Strip vertex 2k and 2k + 1 are the edges at k/3 of the height, tapering to the tip,
+    // and the blade curves forward along a parabola
+    float t = float(gl_VertexID / 2) / 3.0;
+    float side = (gl_VertexID & 1) == 0 ? -0.5 : 0.5;
+    float height = bladeSize.x * heightScale * size;
+    vec3 across = vec3(cos(facing), 0.0, -sin(facing));
+    vec3 forward = vec3(sin(facing), 0.0, cos(facing));
+    vec3 position = root + across * (side * bladeSize.y * size * (1.0 - t)) +
+                    vec3(0.0, t * height, 0.0) + forward * (bend * t * t * height);
+    position += windOffset(root, t * height, bladeSway * stiffness * height, height > 0.0 ? 1.0 / height : 0.0);
+
+    // Blade normal leaned towards the ground's, so the field shades like the terrain under it
+    vec3 tangent = normalize(vec3(0.0, 1.0, 0.0) + forward * (2.0 * bend * t));
+    Normal = normalize(mix(cross(across, tangent), groundNormal, 0.5));
+    FragPos = position;
+    BladeColor = mix(vec3(0.10, 0.28, 0.05), vec3(0.45, 0.70, 0.20), t) * tint;
+    gl_Position = viewProjection * vec4(position, 1.0);
+}
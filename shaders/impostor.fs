@@ -0,0 +1,28 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in float Dither;
+
+uniform sampler2D impostorAtlas;
+
+// 4x4 ordered dither, thresholds in (0, 1)
+float ditherThreshold()
+{
+    const float bayer[16] = float[](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+}
+
+void main()
+{
+    // LOD crossfade, same encoding as model_instanced.fs
+    float threshold = ditherThreshold();
+    if (Dither >= 0.0 ? threshold < Dither : threshold >= -Dither)
+        discard;
+
+    vec4 texColor = texture(impostorAtlas, TexCoords);
+    if (texColor.a < 0.1)
+        discard;
+    FragColor = texColor;
+}
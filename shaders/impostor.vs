@@ -0,0 +1,41 @@
+#version 330 core
+layout (location = 0) in vec4 aPositionScale; // Model origin, uniform scale
+layout (location = 1) in vec4 aRotationDither; // Y rotation in radians, dither value, wind amplitude, inverse height
+
+out vec2 TexCoords;
+out float Dither;
+
+uniform mat4 viewProjection;
+uniform vec3 cameraPosition;
+uniform float impostorRadius;
+uniform vec2 impostorHeightRange;
+uniform int impostorFrames;
+
+const float PI = 3.14159265;
+
+#include "wind.glsl"
+
+void main()
+{
+    // Triangle strip corners from the vertex index: (0,0), (1,0), (0,1), (1,1)
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+    // Upright quad turned towards the camera around Y, like the baked orthographic views
+    vec3 toCamera = cameraPosition - aPositionScale.xyz;
+    toCamera.y = 0.0;
+    vec3 viewDirection = dot(toCamera, toCamera) > 1e-8 ? normalize(toCamera) : vec3(0.0, 0.0, 1.0);
+    vec3 right = normalize(cross(-viewDirection, vec3(0.0, 1.0, 0.0)));
+    float scale = aPositionScale.w;
+    vec3 worldPos = aPositionScale.xyz + right * ((corner.x * 2.0 - 1.0) * impostorRadius * scale);
+    worldPos.y += mix(impostorHeightRange.x, impostorHeightRange.y, corner.y) * scale;
+    worldPos += windOffset(aPositionScale.xyz, worldPos.y - aPositionScale.y, aRotationDither.z, aRotationDither.w);
+
+    // Frame whose bake direction is closest to the view direction in model space
+    float s = sin(aRotationDither.x), c = cos(aRotationDither.x);
+    vec2 local = vec2(viewDirection.x * c - viewDirection.z * s, viewDirection.x * s + viewDirection.z * c);
+    float frame = mod(floor(atan(local.x, local.y) / (2.0 * PI) * float(impostorFrames) + 0.5), float(impostorFrames));
+
+    TexCoords = vec2((frame + corner.x) / float(impostorFrames), corner.y);
+    Dither = aRotationDither.y;
+    gl_Position = viewProjection * vec4(worldPos, 1.0);
+}
@@ -0,0 +1,31 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aInstanceModel; // Per-instance model matrix, locations 5-8
+
+out vec2 TexCoords;
+out float Dither;
+
+out float vertexHeight; // Pass height to the fragment shader
+
+uniform mat4 viewProjection;
+#include "wind.glsl"
+
+void main()
+{
+    // The matrix is affine, so the unused bottom row carries the LOD dither value, the
+    // wind amplitude and the inverse height (Terrain::updateObjectTransforms)
+    mat4 model = aInstanceModel;
+    Dither = model[0][3];
+    float windAmplitude = model[1][3], invHeight = model[2][3];
+    model[0][3] = 0.0;
+    model[1][3] = 0.0;
+    model[2][3] = 0.0;
+
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    worldPos.xyz += windOffset(model[3].xyz, worldPos.y - model[3].y, windAmplitude, invHeight);
+    TexCoords = aTexCoords;
+    gl_Position = viewProjection * worldPos;
+    vertexHeight = aPos.y; // Pass height (Y-coordinate) to fragment shader
+}
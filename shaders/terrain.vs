@@ -1,19 +1,27 @@
 #version 450 core
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec2 texCoords;
-layout(location = 2) in vec3 normal; // Tambahkan normal vector sebagai input
+layout(location = 0) in vec2 gridPos;      // Posisi grid relatif terhadap origin chunk
+layout(location = 1) in float height;      // Tinggi yang dinormalisasi ke [0, 1]
+layout(location = 2) in vec4 packedNormal; // Normal 10:10:10:2, di-bias ke [0, 1]
+layout(location = 3) in vec2 chunkOrigin;  // Origin chunk (atribut per instance)
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+uniform float terrainScale;
+uniform vec2 terrainExtent; // Ukuran grid terrain dalam world space
+
 out vec2 TexCoords;
 out vec3 FragPos;  // Untuk posisi fragmen dalam world space
 out vec3 Normal;   // Untuk normal fragmen dalam world space
 
 void main() {
+    vec2 worldXZ = chunkOrigin + gridPos;
+    vec3 position = vec3(worldXZ.x, height * terrainScale, worldXZ.y);
+    vec3 normal = packedNormal.xyz * 2.0 - 1.0;
+
     gl_Position = projection * view * model * vec4(position, 1.0);
-    TexCoords = texCoords;
+    TexCoords = worldXZ / terrainExtent * 27.0;
 
     // Hitung posisi fragmen dalam world space
     FragPos = vec3(model * vec4(position, 1.0));
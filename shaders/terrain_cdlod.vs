@@ -0,0 +1,60 @@
+#version 460 core
+
+#define CDLOD_MAX_LEVELS 12
+
+layout(location = 0) in vec2 gridPos; // Patch grid position in [0, 1]
+layout(location = 3) in vec4 node;    // offset.xz, size, LOD level
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform sampler2D heightMap;
+uniform sampler2D normalMap; // Same texel layout as heightMap
+uniform vec2 heightmapSize;
+uniform vec2 terrainExtent; // World-space size of the terrain grid
+uniform float terrainScale;
+uniform float patchSize;    // Quads per patch side
+uniform float leafSize;     // World-space size of a LOD 0 node
+uniform vec3 cameraPos;
+uniform vec2 morphRanges[CDLOD_MAX_LEVELS];
+
+float sampleHeight(vec2 worldXZ) {
+    // Texel centres sit on integer world coordinates, like in Terrain::getHeightAt
+    return textureLod(heightMap, (worldXZ + 0.5) / heightmapSize, 0.0).r * terrainScale;
+}
+
+void main() {
+    vec2 nodeOffset = node.xy;
+    float nodeSize = node.z;
+    int lodLevel = int(node.w);
+
+    // Quads across this node at its LOD. Equals patchSize, except for a quarter of a
+    // node drawn at its parent's LOD, where every other vertex collapses onto the coarser grid.
+    float lodQuads = patchSize * nodeSize / (leafSize * exp2(float(lodLevel)));
+    vec2 lodGridPos = floor(gridPos * lodQuads + 0.0001) / lodQuads;
+
+    // Morph odd vertices onto the next coarser grid as the camera moves away
+    vec2 worldXZ = nodeOffset + lodGridPos * nodeSize;
+    float dist = distance(cameraPos, vec3(worldXZ.x, sampleHeight(worldXZ), worldXZ.y));
+    vec2 morphRange = morphRanges[lodLevel];
+    float morphK = clamp((dist - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+    vec2 fracPart = fract(lodGridPos * lodQuads * 0.5) * 2.0 / lodQuads;
+    worldXZ = nodeOffset + (lodGridPos - fracPart * morphK) * nodeSize;
+    worldXZ = min(worldXZ, terrainExtent); // Nodes on the far edges overhang the grid
+
+    vec3 position = vec3(worldXZ.x, sampleHeight(worldXZ), worldXZ.y);
+
+    // Baked Sobel normal, stored biased to [0, 1]
+    vec3 normal = normalize(textureLod(normalMap, (worldXZ + 0.5) / heightmapSize, 0.0).xyz * 2.0 - 1.0);
+
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * normal;
+    TexCoords = worldXZ / terrainExtent * 27.0; // Same texture repeat as the full-resolution mesh
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
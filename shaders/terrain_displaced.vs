@@ -0,0 +1,37 @@
+#version 460 core
+
+layout(location = 0) in vec2 gridPos; // Patch grid position in [0, 1]
+layout(location = 3) in vec4 node;    // offset.xz, size, unused
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform sampler2D heightMap;
+uniform sampler2D normalMap; // Same texel layout as heightMap
+uniform vec2 heightmapSize;
+uniform vec2 terrainExtent; // World-space size of the terrain grid
+uniform float terrainScale;
+
+float sampleHeight(vec2 worldXZ) {
+    // Texel centres sit on integer world coordinates, like in Terrain::getHeightAt
+    return textureLod(heightMap, (worldXZ + 0.5) / heightmapSize, 0.0).r * terrainScale;
+}
+
+void main() {
+    vec2 worldXZ = min(node.xy + gridPos * node.z, terrainExtent); // Edge patches overhang the grid
+    vec3 position = vec3(worldXZ.x, sampleHeight(worldXZ), worldXZ.y);
+
+    // Baked Sobel normal, stored biased to [0, 1]
+    vec3 normal = normalize(textureLod(normalMap, (worldXZ + 0.5) / heightmapSize, 0.0).xyz * 2.0 - 1.0);
+
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * normal;
+    TexCoords = worldXZ / terrainExtent * 27.0; // Same texture repeat as the full-resolution mesh
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -17,6 +17,18 @@ in vec3 Normal;
 uniform sampler2D diffuseTexture;
 uniform vec3 viewPos;
 
+// Splat material: layers of one texture array, weighted by height and slope or by a weight map
+#define MAX_SPLAT_LAYERS 8
+uniform bool useSplatting;
+uniform sampler2DArray splatLayers;
+uniform int splatLayerCount;
+uniform vec4 splatHeightSlope[MAX_SPLAT_LAYERS]; // Height range in xy (normalized), slope range in zw
+uniform float splatBlend[MAX_SPLAT_LAYERS];
+uniform bool useSplatWeightMap;
+uniform sampler2D splatWeights; // RGBA = weights of layers 0-3
+uniform vec2 splatWorldSize;    // World-space size the weight map is stretched over
+uniform float terrainScale;
+
 out vec4 FragColor;
 
 vec3 calculateBlinnPhong(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
@@ -37,12 +49,45 @@ vec3 calculateBlinnPhong(PointLight light, vec3 normal, vec3 fragPos, vec3 viewD
     return diffuse + specular;
 }
 
+// Fades in over `blend` around both ends of the range
+float bandWeight(float value, vec2 range, float blend) {
+    return smoothstep(range.x - blend, range.x + blend, value) * (1.0 - smoothstep(range.y - blend, range.y + blend, value));
+}
+
+vec4 splatColor(vec3 normal) {
+    float height = terrainScale > 0.0 ? FragPos.y / terrainScale : 0.0;
+    float slope = sqrt(max(1.0 - normal.y * normal.y, 0.0)) / max(normal.y, 1e-3);
+    vec4 mapWeights = useSplatWeightMap ? texture(splatWeights, FragPos.xz / splatWorldSize) : vec4(0.0);
+
+    // Derivatives are taken here, in uniform control flow: inside the weight test below
+    // implicit ones would be undefined and break mip selection along band edges
+    vec2 texCoordsDx = dFdx(TexCoords), texCoordsDy = dFdy(TexCoords);
+
+    vec4 color = vec4(0.0);
+    float totalWeight = 0.0;
+    for (int i = 0; i < splatLayerCount; ++i) {
+        float weight;
+        if (useSplatWeightMap) {
+            weight = i < 4 ? mapWeights[i] : 0.0;
+        } else {
+            weight = bandWeight(height, splatHeightSlope[i].xy, splatBlend[i]) *
+                     bandWeight(slope, splatHeightSlope[i].zw, splatBlend[i]);
+        }
+        if (weight > 0.0) { // Skip the fetch for layers that do not contribute
+            color += weight * textureGrad(splatLayers, vec3(TexCoords, float(i)), texCoordsDx, texCoordsDy);
+            totalWeight += weight;
+        }
+    }
+    // Nothing matched: fall back to the first layer rather than black
+    return totalWeight > 1e-4 ? color / totalWeight : textureGrad(splatLayers, vec3(TexCoords, 0.0), texCoordsDx, texCoordsDy);
+}
+
 void main() {
     vec3 norm = normalize(Normal); // Normalize the normal
     vec3 viewDir = normalize(viewPos - FragPos); // View direction
 
     // Base color from texture
-    vec4 texColor = texture(diffuseTexture, TexCoords);
+    vec4 texColor = useSplatting ? splatColor(norm) : texture(diffuseTexture, TexCoords);
 
     // Ambient light contribution
     vec3 ambient = 0.5 * vec3(1.0, 1.0, 1.0); // Soft white ambient light
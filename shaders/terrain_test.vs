@@ -1,8 +1,9 @@
 #version 460 core
 
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec2 texCoords;
-layout(location = 2) in vec3 normal;
+layout(location = 0) in vec2 gridPos;      // Grid position relative to the chunk origin
+layout(location = 1) in float height;      // Height normalized to [0, 1]
+layout(location = 2) in vec4 packedNormal; // 10:10:10:2 normal, biased to [0, 1]
+layout(location = 3) in vec2 chunkOrigin;  // Per-chunk instanced attribute
 
 out vec2 TexCoords;
 out vec3 FragPos;
@@ -12,10 +13,17 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+uniform float terrainScale;
+uniform vec2 terrainExtent; // World-space size of the terrain grid
+
 void main() {
+    vec2 worldXZ = chunkOrigin + gridPos;
+    vec3 position = vec3(worldXZ.x, height * terrainScale, worldXZ.y);
+    vec3 normal = packedNormal.xyz * 2.0 - 1.0;
+
     FragPos = vec3(model * vec4(position, 1.0)); // World position of the vertex
     Normal = mat3(transpose(inverse(model))) * normal; // Correct normals for transformations
-    TexCoords = texCoords;
+    TexCoords = worldXZ / terrainExtent * 27.0; // Repeat the texture 27 times across the terrain
 
     gl_Position = projection * view * vec4(FragPos, 1.0); // Transform to clip space
 }
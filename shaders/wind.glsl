@@ -0,0 +1,18 @@
+// Shared by the vegetation vertex shaders through #include "wind.glsl" (expanded by Shader)
+
+uniform float time;
+uniform vec2 wind; // World xz direction scaled by strength; zero is calm
+
+// Sideways sway of a point heightAbove its instance's root. amplitude is how far the top
+// moves at a wind strength of 1, invHeight one over the instance's height; bending grows
+// with the square of the relative height, so roots stay put. Gusts roll along the wind
+// and a hash of the root offsets each instance's phase; they peak at 1.15 times the wind,
+// which the CPU-side bounds pad for.
+vec3 windOffset(vec3 root, float heightAbove, float amplitude, float invHeight)
+{
+    float weight = clamp(heightAbove * invHeight, 0.0, 1.0);
+    float along = dot(root.xz, wind) / max(length(wind), 1e-4);
+    float phase = fract(sin(dot(root.xz, vec2(12.9898, 78.233))) * 43758.5453) * 6.2831853;
+    float gust = 0.6 + 0.4 * sin(time * 1.3 - along * 0.2) + 0.15 * sin(time * 4.7 + phase);
+    return vec3(wind.x, 0.0, wind.y) * (amplitude * weight * weight * gust);
+}
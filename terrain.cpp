@@ -1,8 +1,28 @@
 #include "lib/terrain.h"
+#include "lib/mapped_file.h"
+#include "lib/draw_sort.h"
+#include "lib/terrain_cache.h"
+#include "lib/mesh_optimizer.h"
+#include "lib/terrain_generator.h"
 #include <glad/glad.h>
 
 #include <GLFW/glfw3.h> // Make sure to include OpenGL context libraries
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <map>
+#ifdef TERRAIN_BENCHMARK
+#include <random>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_SSE2
+#include <emmintrin.h>
+#endif
 
 // Custom clamp function for versions of C++ before C++17
 template <typename T>
@@ -12,153 +32,514 @@ T clamp(const T &value, const T &low, const T &high) {
 }
 
 // Constructor
-Terrain::Terrain(const std::string &heightmapPath, float scale, int width, int height)
+Terrain::Terrain(const std::string &heightmapPath, float scale, int width, int height, TerrainRenderMode mode)
     : terrainScale(scale), terrainWidth(width), terrainHeight(height), textureID(0) { // Initialize textureID
+    if (std::ifstream(heightmapPath + "/" + TERRAIN_TILE_MANIFEST).good()) {
+        // World larger than one heightmap: tiles are streamed in around the player
+        streamer.reset(new TerrainStreamer(heightmapPath, scale));
+        if (streamer->isValid()) {
+            terrainWidth = streamer->getWorldWidth();
+            terrainHeight = streamer->getWorldHeight();
+            glm::vec2 heightRange = streamer->getHeightRange();
+            minCorner = glm::vec3(0.0f, heightRange.x, 0.0f);
+            maxCorner = glm::vec3((float)(terrainWidth - 1), heightRange.y, (float)(terrainHeight - 1));
+            return;
+        }
+        streamer.reset();
+    }
+
+    // A cooked file for the same source and parameters skips decoding, baking and meshing
+    bool withMesh = mode == TerrainRenderMode::Mesh;
+    uint64_t cacheKey;
+    bool cacheable = TerrainCache::computeKey(heightmapPath, scale, width, height, withMesh, cacheKey);
+    if (cacheable && TerrainCache::load(*this, cacheKey, withMesh)) {
+        setRenderMode(mode);
+        return;
+    }
+
     if (!loadHeightmap(heightmapPath)) {
         std::cerr << "Error loading heightmap!" << std::endl;
     }
-    generateTerrain();
-    setupTerrainBuffers();
+    computeChunkBounds();
+    bakeNormals();
+    heightPyramid.reset(new HeightPyramid(heightmapData.data(), heightmapWidth, heightmapHeight, terrainScale));
+    if (withMesh) {
+        generateTerrain(); // Staged before setRenderMode uploads it, so it can be cooked
+    }
+    if (cacheable) {
+        TerrainCache::save(*this, cacheKey);
+    }
+    setRenderMode(mode); // Builds only the GPU resources the mode needs
 }
 
 // Destructor
 Terrain::~Terrain() {
-    stbi_image_free(heightmapData);
-    glDeleteBuffers(1, &terrainVBO);
-    glDeleteBuffers(1, &terrainEBO);
-    glDeleteVertexArrays(1, &terrainVAO);
+    deleteTerrainBuffers();
 
+    if (patchVAO != 0) {
+        glDeleteBuffers(1, &patchVBO);
+        glDeleteBuffers(1, &patchEBO);
+        glDeleteBuffers(1, &nodeInstanceVBO);
+        glDeleteVertexArrays(1, &patchVAO);
+    }
+    if (heightTextureID != 0) {
+        glDeleteTextures(1, &heightTextureID);
+    }
+    if (normalTextureID != 0) {
+        glDeleteTextures(1, &normalTextureID);
+    }
     if (textureID != 0) {
         glDeleteTextures(1, &textureID); // Clean up texture
     }
 }
 
 bool Terrain::loadHeightmap(const std::string &path) {
-    heightmapData = stbi_load(path.c_str(), &heightmapWidth, &heightmapHeight, nullptr, 1); // Load as grayscale (1 channel)
+    size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    bool loaded;
+    if (path.compare(0, std::strlen(TERRAIN_PROCEDURAL_PREFIX), TERRAIN_PROCEDURAL_PREFIX) == 0) {
+        loaded = generateHeightmap(path);
+    } else if (extension == "r16") {
+        loaded = loadRawHeightmap(path, 16);
+    } else if (extension == "f32") {
+        loaded = loadRawHeightmap(path, 32);
+    } else {
+        loaded = loadImageHeightmap(path);
+    }
 
-    if (!heightmapData) {
+    if (!loaded) {
         std::cerr << "Failed to load heightmap: " << path << std::endl;
         return false; // Indicate failure if heightmap is not loaded
     }
 
-    std::cout << "Heightmap loaded successfully! Width: " << heightmapWidth << ", Height: " << heightmapHeight << std::endl;
+    std::cout << "Heightmap loaded successfully! Width: " << heightmapWidth << ", Height: " << heightmapHeight
+              << ", Bits: " << heightmapBits << std::endl;
     return true;
 }
 
-void Terrain::generateTerrain() {
-    minCorner = glm::vec3(0.0f, FLT_MAX, 0.0f);                                 // Initialize minCorner
-    maxCorner = glm::vec3((float)terrainWidth, -FLT_MAX, (float)terrainHeight); // Initialize maxCorner
+bool Terrain::loadImageHeightmap(const std::string &path) {
+    // Always through the 16-bit path: 16-bit PNGs keep their precision and
+    // 8-bit images are widened exactly (v * 257)
+    int width, height, channels;
+    stbi_us *pixels = stbi_load_16(path.c_str(), &width, &height, &channels, 0);
+    if (!pixels) {
+        std::cerr << "stb_image error: " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    if (channels > 1) {
+        std::cout << "Heightmap has " << channels << " channels, using the first one" << std::endl;
+    }
+
+    // Take the first channel as is; converting to luma would mix colour into the heights
+    heightmapData.resize((size_t)width * height);
+    for (size_t i = 0; i < heightmapData.size(); ++i) {
+        heightmapData[i] = pixels[i * channels] / 65535.0f;
+    }
+    stbi_image_free(pixels);
+
+    heightmapWidth = width;
+    heightmapHeight = height;
+    heightmapBits = 16;
+    return true;
+}
+
+bool Terrain::generateHeightmap(const std::string &spec) {
+    TerrainGeneratorSettings settings;
+    settings.width = terrainWidth;
+    settings.height = terrainHeight;
+    if (!TerrainGenerator::parse(spec, settings)) {
+        return false;
+    }
+    if (settings.width < 2 || settings.height < 2) {
+        std::cerr << "Procedural terrain needs at least 2x2 samples" << std::endl;
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TerrainGenerator::generate(settings, heightmapData);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Generated terrain (seed " << settings.seed << ") in " << elapsed.count() << " ms" << std::endl;
+
+    heightmapWidth = settings.width;
+    heightmapHeight = settings.height;
+    heightmapBits = 32; // Full float precision, uploaded as R32F
+    return true;
+}
+
+bool Terrain::loadRawHeightmap(const std::string &path, int bits) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+
+    // Raw files carry no header; they have to be square
+    size_t sampleSize = bits / 8;
+    size_t sampleCount = file.size() / sampleSize;
+    int side = (int)std::lround(std::sqrt((double)sampleCount));
+    if ((size_t)side * side * sampleSize != file.size()) {
+        std::cerr << "Raw heightmap is not a square grid of " << bits << "-bit samples: " << path << std::endl;
+        return false;
+    }
+
+    // Converted straight from the mapping in blocks, each released once read, so the file is
+    // never resident alongside the heights as a whole. Assumes a little-endian host.
+    const size_t blockSamples = (size_t)1 << 20;
+    std::vector<float> heights(sampleCount);
+    for (size_t first = 0; first < sampleCount; first += blockSamples) {
+        size_t last = std::min(first + blockSamples, sampleCount);
+        if (bits == 16) {
+            const GLushort *samples = static_cast<const GLushort *>(file.data());
+            for (size_t i = first; i < last; ++i) {
+                heights[i] = samples[i] / 65535.0f;
+            }
+        } else {
+            std::memcpy(&heights[first], static_cast<const float *>(file.data()) + first, (last - first) * sampleSize);
+            for (size_t i = first; i < last; ++i) {
+                if (!std::isfinite(heights[i])) {
+                    std::cerr << "Raw heightmap has a non-finite sample at " << i % side << ", " << i / side << ": "
+                              << path << std::endl;
+                    return false;
+                }
+            }
+        }
+        file.release(first * sampleSize, (last - first) * sampleSize);
+    }
+
+    heightmapData.swap(heights);
+    heightmapWidth = heightmapHeight = side;
+    heightmapBits = bits;
+    return true;
+}
+
+void Terrain::computeChunkBounds() {
+    minCorner = glm::vec3(0.0f, FLT_MAX, 0.0f);                                             // Initialize minCorner
+    maxCorner = glm::vec3((float)(terrainWidth - 1), -FLT_MAX, (float)(terrainHeight - 1)); // Initialize maxCorner
 
-    for (int z = 0; z < terrainHeight; ++z) {
-        for (int x = 0; x < terrainWidth; ++x) {
-            float height = getHeightAt(x, z);
+    chunks.clear();
+    for (int chunkZ = 0; chunkZ < terrainHeight - 1; chunkZ += TERRAIN_CHUNK_SIZE) {
+        for (int chunkX = 0; chunkX < terrainWidth - 1; chunkX += TERRAIN_CHUNK_SIZE) {
+            int endX = std::min(chunkX + TERRAIN_CHUNK_SIZE, terrainWidth - 1);
+            int endZ = std::min(chunkZ + TERRAIN_CHUNK_SIZE, terrainHeight - 1);
 
-            // Update minCorner and maxCorner
-            minCorner.y = glm::min(minCorner.y, height);
-            maxCorner.y = glm::max(maxCorner.y, height);
-            const float tolerance = 1.0f; // Expand the bounding box slightly
-            minCorner -= glm::vec3(tolerance);
-            maxCorner += glm::vec3(tolerance);
+            TerrainChunk chunk;
+            chunk.minCorner = glm::vec3((float)chunkX, FLT_MAX, (float)chunkZ);
+            chunk.maxCorner = glm::vec3((float)endX, -FLT_MAX, (float)endZ);
+            chunk.indexOffset = 0;
+            chunk.indexCount = 0;
 
-            vertices.push_back(x);      // X
-            vertices.push_back(height); // Y
-            vertices.push_back(z);      // Z
+            // Tight height bounds over every vertex the chunk touches, edges included
+            for (int z = chunkZ; z <= endZ; ++z) {
+                for (int x = chunkX; x <= endX; ++x) {
+                    float height = getHeightAt(x, z);
+                    chunk.minCorner.y = glm::min(chunk.minCorner.y, height);
+                    chunk.maxCorner.y = glm::max(chunk.maxCorner.y, height);
+                }
+            }
 
-            // Scale texture coordinates to make the texture smaller (repeat it more times)
-            float u = (float)x / (terrainWidth - 1) * 27.0f;  // Repeat the texture n times in X direction
-            float v = (float)z / (terrainHeight - 1) * 27.0f; // Repeat the texture n times in Z direction
-            texCoords.push_back(u);                           // U
-            texCoords.push_back(v);                           // V
+            minCorner.y = glm::min(minCorner.y, chunk.minCorner.y);
+            maxCorner.y = glm::max(maxCorner.y, chunk.maxCorner.y);
+            chunks.push_back(chunk);
         }
     }
+}
 
-    // Generate indices for terrain mesh (triangle grid)
-    for (int z = 0; z < terrainHeight - 1; ++z) {
-        for (int x = 0; x < terrainWidth - 1; ++x) {
-            int topLeft = z * terrainWidth + x;
-            int bottomLeft = (z + 1) * terrainWidth + x;
+void Terrain::bakeNormals() {
+    if (heightmapData.empty()) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    TerrainNormals::bake(heightmapData.data(), heightmapWidth, heightmapHeight, terrainScale, normalData);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Baked terrain normals in " << elapsed.count() << " ms" << std::endl;
+    uploadNormalTexture();
+}
 
-            indices.push_back(topLeft);
-            indices.push_back(bottomLeft);
-            indices.push_back(topLeft + 1);
+void Terrain::uploadNormalTexture() {
+    if (normalTextureID == 0) {
+        glGenTextures(1, &normalTextureID);
+        glBindTexture(GL_TEXTURE_2D, normalTextureID);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, normalTextureID);
+    }
+    // Respecified every bake; the size follows the heightmap
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, heightmapWidth, heightmapHeight, 0, GL_RGBA,
+                 GL_UNSIGNED_INT_2_10_10_10_REV, normalData.data());
+}
 
-            indices.push_back(bottomLeft);
-            indices.push_back(bottomLeft + 1);
-            indices.push_back(topLeft + 1);
+void Terrain::appendGridStrips(std::vector<GLushort> &stripIndices, int quadsX, int quadsZ) {
+    int rowLength = quadsX + 1;
+    for (int bandX = 0; bandX < quadsX; bandX += TERRAIN_STRIP_BAND) {
+        int bandEnd = std::min(bandX + TERRAIN_STRIP_BAND, quadsX);
+        for (int z = 0; z < quadsZ; ++z) {
+            // Alternating top/bottom vertices keep the winding of the old triangle list
+            for (int x = bandX; x <= bandEnd; ++x) {
+                stripIndices.push_back((GLushort)(z * rowLength + x));
+                stripIndices.push_back((GLushort)((z + 1) * rowLength + x));
+            }
+            stripIndices.push_back(TERRAIN_RESTART_INDEX);
         }
     }
 }
 
+Terrain::TerrainVertex Terrain::makeVertex(int x, int z, int chunkX, int chunkZ) const {
+    TerrainVertex vertex;
+    vertex.x = (GLubyte)(x - chunkX);
+    vertex.z = (GLubyte)(z - chunkZ);
+    float height = terrainScale > 0.0f ? getHeightAt(x, z) / terrainScale : 0.0f;
+    vertex.height = (GLushort)(glm::clamp(height, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    vertex.normal = normalData[z * heightmapWidth + x];
+    return vertex;
+}
+
+void Terrain::generateTerrain() {
+    vertices.clear();
+    indices.clear();
+    std::map<std::pair<int, int>, std::pair<GLuint, GLsizei>> stripRanges; // Chunk size -> index range
+
+    // Every chunk gets its own block of vertices (edges are duplicated) so positions can be chunk-local
+    for (auto &chunk : chunks) {
+        int chunkX = (int)chunk.minCorner.x, chunkZ = (int)chunk.minCorner.z;
+        int endX = (int)chunk.maxCorner.x, endZ = (int)chunk.maxCorner.z;
+        chunk.baseVertex = (GLint)vertices.size();
+
+        for (int z = chunkZ; z <= endZ; ++z) {
+            for (int x = chunkX; x <= endX; ++x) {
+                vertices.push_back(makeVertex(x, z, chunkX, chunkZ));
+            }
+        }
+
+        // Indices are relative to the chunk's base vertex, so all chunks of one size share them
+        std::pair<int, int> size(endX - chunkX, endZ - chunkZ);
+        auto range = stripRanges.find(size);
+        if (range == stripRanges.end()) {
+            GLuint offset = static_cast<GLuint>(indices.size());
+            appendGridStrips(indices, size.first, size.second);
+            range = stripRanges.emplace(size, std::make_pair(offset, static_cast<GLsizei>(indices.size() - offset))).first;
+        }
+        chunk.indexOffset = range->second.first;
+        chunk.indexCount = range->second.second;
+    }
+
+    // Strips are already in cache order; report their ACMR next to the models' for comparison
+    if (!stripRanges.empty()) {
+        const auto &full = *stripRanges.rbegin(); // Largest chunk size
+        int quadsX = full.first.first, quadsZ = full.first.second;
+        float acmr = MeshOptimizer::computeACMR(indices.data() + full.second.first, (size_t)full.second.second,
+                                                (size_t)(2 * quadsX * quadsZ), (size_t)((quadsX + 1) * (quadsZ + 1)),
+                                                MESH_OPTIMIZER_REPORT_CACHE, TERRAIN_RESTART_INDEX);
+        std::cout << "Terrain chunk strips: " << quadsX << "x" << quadsZ << " quads, ACMR " << acmr << std::endl;
+    }
+}
+
 void Terrain::setupTerrainBuffers() {
+    uploadTerrainMesh(vertices.data(), vertices.size(), indices.data(), indices.size());
+
+    // The GPU owns the mesh now; heights stay queryable through heightmapData
+    std::vector<TerrainVertex>().swap(vertices);
+    std::vector<GLushort>().swap(indices);
+}
+
+void Terrain::uploadTerrainMesh(const TerrainVertex *vertexData, size_t vertexCount, const GLushort *indexData,
+                                size_t indexCount) {
     glGenVertexArrays(1, &terrainVAO);
     glGenBuffers(1, &terrainVBO);
     glGenBuffers(1, &terrainEBO);
+    glGenBuffers(1, &chunkOriginVBO);
+    glGenBuffers(1, &indirectBuffer);
 
     glBindVertexArray(terrainVAO);
 
+    // Interleaved, packed vertices
     glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
-    glBufferData(GL_ARRAY_BUFFER, (vertices.size() + texCoords.size()) * sizeof(float), nullptr, GL_STATIC_DRAW);
-
-    // Upload the vertices and texture coordinates to the buffer
-    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
-    glBufferSubData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), texCoords.size() * sizeof(float), texCoords.data());
+    // Patched in place by deform
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(TerrainVertex), vertexData, GL_DYNAMIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrainEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLushort), indexData, GL_STATIC_DRAW);
+
+    std::vector<glm::vec2> chunkOrigins;
+    for (const auto &chunk : chunks) {
+        chunkOrigins.push_back(glm::vec2(chunk.minCorner.x, chunk.minCorner.z));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, chunkOriginVBO);
+    glBufferData(GL_ARRAY_BUFFER, chunkOrigins.size() * sizeof(glm::vec2), chunkOrigins.data(), GL_STATIC_DRAW);
+
+    setupPackedVertexLayout(terrainVBO, chunkOriginVBO);
+    glBindVertexArray(0);
+}
 
-    // Position attribute (location = 0)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+void Terrain::setupPackedVertexLayout(GLuint vertexBuffer, GLuint chunkOriginBuffer) {
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+    // Chunk-local grid position attribute (location = 0)
+    glVertexAttribPointer(0, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(TerrainVertex), (void *)offsetof(TerrainVertex, x));
     glEnableVertexAttribArray(0);
 
-    // Texture coordinates attribute (location = 1)
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)(vertices.size() * sizeof(float)));
+    // Normalized height attribute (location = 1)
+    glVertexAttribPointer(1, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(TerrainVertex), (void *)offsetof(TerrainVertex, height));
     glEnableVertexAttribArray(1);
 
-    glBindVertexArray(0);
+    // Packed normal attribute (location = 2)
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_INT_2_10_10_10_REV, GL_TRUE, sizeof(TerrainVertex), (void *)offsetof(TerrainVertex, normal));
+    glEnableVertexAttribArray(2);
+
+    // Chunk origin attribute (location = 3), one per draw through baseInstance
+    glBindBuffer(GL_ARRAY_BUFFER, chunkOriginBuffer);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *)0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
 }
 
-bool Terrain::isInsideFrustum(const glm::vec4 planes[6]) const {
-    for (int i = 0; i < 6; ++i) {
-        bool isOutside = true;
-
-        // Check all 8 corners of the bounding box against the plane
-        for (const auto &corner : {
-                 glm::vec4(minCorner.x, minCorner.y, minCorner.z, 1.0f),
-                 glm::vec4(maxCorner.x, minCorner.y, minCorner.z, 1.0f),
-                 glm::vec4(minCorner.x, maxCorner.y, minCorner.z, 1.0f),
-                 glm::vec4(maxCorner.x, maxCorner.y, minCorner.z, 1.0f),
-                 glm::vec4(minCorner.x, minCorner.y, maxCorner.z, 1.0f),
-                 glm::vec4(maxCorner.x, minCorner.y, maxCorner.z, 1.0f),
-                 glm::vec4(minCorner.x, maxCorner.y, maxCorner.z, 1.0f),
-                 glm::vec4(maxCorner.x, maxCorner.y, maxCorner.z, 1.0f)}) {
-            if (glm::dot(planes[i], corner) >= 0.0f) {
-                isOutside = false; // At least one point is inside
-                break;
-            }
+void Terrain::deleteTerrainBuffers() {
+    if (terrainVAO != 0) {
+        glDeleteBuffers(1, &terrainVBO);
+        glDeleteBuffers(1, &terrainEBO);
+        glDeleteBuffers(1, &chunkOriginVBO);
+        glDeleteBuffers(1, &indirectBuffer);
+        glDeleteVertexArrays(1, &terrainVAO);
+        terrainVAO = terrainVBO = terrainEBO = chunkOriginVBO = indirectBuffer = 0;
+    }
+}
+
+void Terrain::setupHeightTexture() {
+    glGenTextures(1, &heightTextureID);
+    uploadHeightTexture(true);
+
+    // Linear filtering reproduces the bilinear interpolation of getHeightAt
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void Terrain::uploadHeightTexture(bool respecify) {
+    glBindTexture(GL_TEXTURE_2D, heightTextureID);
+    if (heightmapBits > 16) {
+        // Float sources keep their full precision
+        if (respecify) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, heightmapWidth, heightmapHeight, 0, GL_RED, GL_FLOAT, heightmapData.data());
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, heightmapWidth, heightmapHeight, GL_RED, GL_FLOAT, heightmapData.data());
         }
+        return;
+    }
 
-        if (isOutside) {
-            return false; // The box is outside this plane
+    // 16-bit normalized holds 8- and 16-bit sources exactly at half the size of floats
+    std::vector<GLushort> texels(heightmapData.size());
+    for (size_t i = 0; i < texels.size(); ++i) {
+        texels[i] = (GLushort)(glm::clamp(heightmapData[i], 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2); // Rows of an odd-width 16-bit image are not 4-byte aligned
+    if (respecify) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, heightmapWidth, heightmapHeight, 0, GL_RED, GL_UNSIGNED_SHORT, texels.data());
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, heightmapWidth, heightmapHeight, GL_RED, GL_UNSIGNED_SHORT, texels.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void Terrain::setupGridPatch() {
+    // Grid positions in [0, 1]; the vertex shader scales them to the node
+    std::vector<float> patchVertices;
+    for (int z = 0; z <= CDLOD_PATCH_SIZE; ++z) {
+        for (int x = 0; x <= CDLOD_PATCH_SIZE; ++x) {
+            patchVertices.push_back((float)x / CDLOD_PATCH_SIZE);
+            patchVertices.push_back((float)z / CDLOD_PATCH_SIZE);
         }
     }
-    return true; // The box is inside or intersects all planes
+    std::vector<GLushort> patchIndices;
+    appendGridStrips(patchIndices, CDLOD_PATCH_SIZE, CDLOD_PATCH_SIZE);
+    patchIndexCount = (GLsizei)patchIndices.size();
+
+    glGenVertexArrays(1, &patchVAO);
+    glGenBuffers(1, &patchVBO);
+    glGenBuffers(1, &patchEBO);
+    glGenBuffers(1, &nodeInstanceVBO);
+
+    glBindVertexArray(patchVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, patchVBO);
+    glBufferData(GL_ARRAY_BUFFER, patchVertices.size() * sizeof(float), patchVertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patchEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, patchIndices.size() * sizeof(GLushort), patchIndices.data(), GL_STATIC_DRAW);
+
+    // Grid position attribute (location = 0)
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+
+    // Per-node attribute (location = 3): offset.xz, size, LOD level
+    glBindBuffer(GL_ARRAY_BUFFER, nodeInstanceVBO);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainQuadtree::SelectedNode), (void *)0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    glBindVertexArray(0);
 }
 
-void Terrain::render(Shader &shader, const glm::mat4 &vp) {
-    // Calculate frustum planes
-    glm::vec4 planes[6];
-    planes[0] = glm::vec4(vp[3] + vp[0]);
-    planes[1] = glm::vec4(vp[3] - vp[0]);
-    planes[2] = glm::vec4(vp[3] + vp[1]);
-    planes[3] = glm::vec4(vp[3] - vp[1]);
-    planes[4] = glm::vec4(vp[3] + vp[2]);
-    planes[5] = glm::vec4(vp[3] - vp[2]);
-    for (int i = 0; i < 6; ++i) {
-        planes[i] = glm::normalize(planes[i]);
+void Terrain::setRenderMode(TerrainRenderMode mode) {
+    if (streamer) {
+        // Tiles are always meshed; the GPU-displaced modes need the whole heightmap as a texture
+        if (mode != TerrainRenderMode::Mesh) {
+            std::cerr << "Streamed terrain only supports the Mesh render mode" << std::endl;
+        }
+        return;
     }
+    if (mode == TerrainRenderMode::Mesh && terrainVAO == 0) {
+        if (vertices.empty()) {
+            generateTerrain();
+        }
+        setupTerrainBuffers();
+    }
+    if (mode != TerrainRenderMode::Mesh && heightTextureID == 0) {
+        setupHeightTexture();
+        setupGridPatch();
+    }
+    if (mode == TerrainRenderMode::CDLOD && !quadtree) {
+        quadtree.reset(new TerrainQuadtree(*this, CDLOD_PATCH_SIZE, 2.0f * CDLOD_PATCH_SIZE));
+    }
+    renderMode = mode;
+}
+
+bool Terrain::reloadHeightmap(const std::string &path) {
+    if (streamer) {
+        std::cerr << "Cannot reload the heightmap of streamed terrain" << std::endl;
+        return false;
+    }
+    int oldWidth = heightmapWidth, oldHeight = heightmapHeight, oldBits = heightmapBits;
+    if (!loadHeightmap(path)) {
+        return false;
+    }
+    std::vector<float>().swap(pristineHeights); // Edits of the old heights no longer apply
+    computeChunkBounds();
+    bakeNormals();
+    heightPyramid.reset(new HeightPyramid(heightmapData.data(), heightmapWidth, heightmapHeight, terrainScale));
+
+    // GPU-displaced modes only need the texture refreshed
+    if (heightTextureID != 0) {
+        bool sameFormat = heightmapWidth == oldWidth && heightmapHeight == oldHeight && (heightmapBits > 16) == (oldBits > 16);
+        uploadHeightTexture(!sameFormat);
+    }
+    if (quadtree) {
+        quadtree.reset(new TerrainQuadtree(*this, CDLOD_PATCH_SIZE, 2.0f * CDLOD_PATCH_SIZE));
+    }
+    // The baked mesh has to be rebuilt
+    if (terrainVAO != 0) {
+        deleteTerrainBuffers();
+        generateTerrain();
+        setupTerrainBuffers();
+    }
+    return true;
+}
+
+void Terrain::render(Shader &shader, const glm::mat4 &vp, const glm::vec3 &cameraPosition) {
+    Frustum frustum(vp);
 
     // Perform frustum culling
-    if (!isInsideFrustum(planes)) {
+    if (!frustum.intersectsBox(minCorner, maxCorner)) {
         return; // Skip rendering if the terrain is outside the frustum
     }
 
@@ -166,13 +547,118 @@ void Terrain::render(Shader &shader, const glm::mat4 &vp) {
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, textureID);
     shader.setInt("terrainTexture", 0); // Tell the shader to use texture unit 0
+    shader.setBool("useSplatting", material.isLoaded());
+    if (material.isLoaded()) {
+        material.bind(shader, 3); // Units 1 and 2 hold the height and normal maps
+        shader.setVec2("splatWorldSize", glm::vec2((float)(terrainWidth - 1), (float)(terrainHeight - 1)));
+    }
+
+    if (streamer) {
+        streamer->render(shader, frustum);
+        return;
+    }
+    if (renderMode == TerrainRenderMode::CDLOD) {
+        renderLod(shader, frustum, cameraPosition);
+        return;
+    }
+    if (renderMode == TerrainRenderMode::Displaced) {
+        renderDisplaced(shader, frustum);
+        return;
+    }
+
+    // One indirect command per visible chunk; baseInstance selects the chunk origin
+    drawCommands.clear();
+    for (GLuint i = 0; i < chunks.size(); ++i) {
+        const TerrainChunk &chunk = chunks[i];
+        if (frustum.intersectsBox(chunk.minCorner, chunk.maxCorner)) {
+            drawCommands.push_back({(GLuint)chunk.indexCount, 1, chunk.indexOffset, chunk.baseVertex, i});
+        }
+    }
+    if (drawCommands.empty()) {
+        return;
+    }
+
+    shader.setFloat("terrainScale", terrainScale);
+    shader.setVec2("terrainExtent", glm::vec2((float)(terrainWidth - 1), (float)(terrainHeight - 1)));
 
-    // Render the terrain
     glBindVertexArray(terrainVAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX); // 0xFFFF ends a strip in 16-bit index buffers
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCommands.size() * sizeof(DrawElementsIndirectCommand), drawCommands.data(), GL_STREAM_DRAW);
+    glMultiDrawElementsIndirect(GL_TRIANGLE_STRIP, GL_UNSIGNED_SHORT, 0, (GLsizei)drawCommands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
     glBindVertexArray(0);
 }
 
+void Terrain::renderLod(Shader &shader, const Frustum &frustum, const glm::vec3 &cameraPosition) {
+    quadtree->select(cameraPosition, frustum, selectedNodes);
+    if (selectedNodes.empty()) {
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, heightTextureID);
+    shader.setInt("heightMap", 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, normalTextureID);
+    shader.setInt("normalMap", 2);
+    shader.setVec2("heightmapSize", glm::vec2((float)heightmapWidth, (float)heightmapHeight));
+    shader.setVec2("terrainExtent", glm::vec2((float)(terrainWidth - 1), (float)(terrainHeight - 1)));
+    shader.setFloat("terrainScale", terrainScale);
+    shader.setFloat("patchSize", (float)CDLOD_PATCH_SIZE);
+    shader.setFloat("leafSize", (float)quadtree->getLeafSize());
+    shader.setVec3("cameraPos", cameraPosition);
+    for (int level = 0; level < quadtree->getLevelCount(); ++level) {
+        shader.setVec2("morphRanges[" + std::to_string(level) + "]", quadtree->getMorphRange(level));
+    }
+
+    drawPatchInstances();
+}
+
+void Terrain::renderDisplaced(Shader &shader, const Frustum &frustum) {
+    // Cover every visible chunk with full-resolution patches
+    selectedNodes.clear();
+    for (const auto &chunk : chunks) {
+        if (!frustum.intersectsBox(chunk.minCorner, chunk.maxCorner)) {
+            continue;
+        }
+        for (float z = chunk.minCorner.z; z < chunk.maxCorner.z; z += CDLOD_PATCH_SIZE) {
+            for (float x = chunk.minCorner.x; x < chunk.maxCorner.x; x += CDLOD_PATCH_SIZE) {
+                selectedNodes.push_back({glm::vec2(x, z), (float)CDLOD_PATCH_SIZE, 0.0f});
+            }
+        }
+    }
+    if (selectedNodes.empty()) {
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, heightTextureID);
+    shader.setInt("heightMap", 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, normalTextureID);
+    shader.setInt("normalMap", 2);
+    shader.setVec2("heightmapSize", glm::vec2((float)heightmapWidth, (float)heightmapHeight));
+    shader.setVec2("terrainExtent", glm::vec2((float)(terrainWidth - 1), (float)(terrainHeight - 1)));
+    shader.setFloat("terrainScale", terrainScale);
+
+    drawPatchInstances();
+}
+
+void Terrain::drawPatchInstances() {
+    // All selected nodes go out in one instanced draw
+    glBindBuffer(GL_ARRAY_BUFFER, nodeInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, selectedNodes.size() * sizeof(TerrainQuadtree::SelectedNode), selectedNodes.data(), GL_STREAM_DRAW);
+
+    glBindVertexArray(patchVAO);
+    glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    glDrawElementsInstanced(GL_TRIANGLE_STRIP, patchIndexCount, GL_UNSIGNED_SHORT, 0, (GLsizei)selectedNodes.size());
+    glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
 bool Terrain::loadTexture(const std::string &texturePath) {
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_2D, textureID);
@@ -205,18 +691,38 @@ bool Terrain::loadTexture(const std::string &texturePath) {
     return true;
 }
 
+bool Terrain::loadMaterial(const std::vector<TerrainLayer> &layers, const std::string &weightMapPath) {
+    if (!material.load(layers)) {
+        return false;
+    }
+    return weightMapPath.empty() || material.loadWeightMap(weightMapPath);
+}
+
 float Terrain::getHeightAt(float x, float z) const {
-    // Convert the coordinates to integers for the four corners
-    int x0 = static_cast<int>(x);
-    int z0 = static_cast<int>(z);
-    int x1 = std::min(x0 + 1, heightmapWidth - 1);  // Ensure x1 doesn't go out of bounds
-    int z1 = std::min(z0 + 1, heightmapHeight - 1); // Ensure z1 doesn't go out of bounds
+    if (streamer) {
+        // Tiles that are not resident yet read as the lowest point of the world
+        float height;
+        return streamer->getHeightAt(x, z, height) ? height : minCorner.y;
+    }
+    if (heightmapData.empty()) {
+        return 0.0f;
+    }
+
+    // Clamp onto the grid; written so NaN ends up at 0 like in getHeightsAt
+    x = x > 0.0f ? std::min(x, (float)(heightmapWidth - 1)) : 0.0f;
+    z = z > 0.0f ? std::min(z, (float)(heightmapHeight - 1)) : 0.0f;
+
+    // Cell of the four corners; on the last row/column the fraction becomes 1 instead
+    int x0 = std::min(static_cast<int>(x), std::max(heightmapWidth - 2, 0));
+    int z0 = std::min(static_cast<int>(z), std::max(heightmapHeight - 2, 0));
+    int x1 = std::min(x0 + 1, heightmapWidth - 1);
+    int z1 = std::min(z0 + 1, heightmapHeight - 1);
 
     // Get the heights of the four surrounding points (top-left, top-right, bottom-left, bottom-right)
-    float h00 = heightmapData[z0 * heightmapWidth + x0]; // top-left
-    float h10 = heightmapData[z0 * heightmapWidth + x1]; // top-right
-    float h01 = heightmapData[z1 * heightmapWidth + x0]; // bottom-left
-    float h11 = heightmapData[z1 * heightmapWidth + x1]; // bottom-right
+    float h00 = heightmapData[(size_t)z0 * heightmapWidth + x0]; // top-left
+    float h10 = heightmapData[(size_t)z0 * heightmapWidth + x1]; // top-right
+    float h01 = heightmapData[(size_t)z1 * heightmapWidth + x0]; // bottom-left
+    float h11 = heightmapData[(size_t)z1 * heightmapWidth + x1]; // bottom-right
 
     // Perform bilinear interpolation to calculate the height at (x, z)
     float tx = x - x0; // Relative x-coordinate within the cell
@@ -229,71 +735,743 @@ float Terrain::getHeightAt(float x, float z) const {
     // Interpolate along z-direction (final height)
     float height = h0 + (h1 - h0) * tz;
 
-    // Scale the height as before
-    return terrainScale * (height / 255.0f);
+    // Samples are normalized, so this is the world height
+    return terrainScale * height;
 }
 
-void Terrain::addModel(const std::string &type, const std::string &modelPath) {
+void Terrain::getHeightsAt(const glm::vec2 *positions, float *heights, size_t count) const {
+    size_t i = 0;
+#ifdef TERRAIN_SSE2
+    // Four points per iteration. SSE2 has no gather, so the corner samples are loaded per lane;
+    // clamping, cell selection and interpolation run vectorized.
+    if (!streamer && heightmapWidth >= 2 && heightmapHeight >= 2) {
+        const float *data = heightmapData.data();
+        const size_t rowLength = (size_t)heightmapWidth;
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 maxX = _mm_set1_ps((float)(heightmapWidth - 1));
+        const __m128 maxZ = _mm_set1_ps((float)(heightmapHeight - 1));
+        const __m128 lastCellX = _mm_set1_ps((float)(heightmapWidth - 2));
+        const __m128 lastCellZ = _mm_set1_ps((float)(heightmapHeight - 2));
+        const __m128 scale = _mm_set1_ps(terrainScale);
+        alignas(16) int cellX[4], cellZ[4];
+        alignas(16) float h00[4], h10[4], h01[4], h11[4];
+
+        for (; i + 4 <= count; i += 4) {
+            // Deinterleave (x, z) pairs
+            __m128 pairs01 = _mm_loadu_ps(&positions[i].x);
+            __m128 pairs23 = _mm_loadu_ps(&positions[i + 2].x);
+            __m128 x = _mm_shuffle_ps(pairs01, pairs23, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 z = _mm_shuffle_ps(pairs01, pairs23, _MM_SHUFFLE(3, 1, 3, 1));
+
+            // maxps returns its second operand for NaN, so NaN clamps to 0
+            x = _mm_min_ps(_mm_max_ps(x, zero), maxX);
+            z = _mm_min_ps(_mm_max_ps(z, zero), maxZ);
+            __m128 x0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(x)), lastCellX);
+            __m128 z0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(z)), lastCellZ);
+            _mm_store_si128(reinterpret_cast<__m128i *>(cellX), _mm_cvttps_epi32(x0));
+            _mm_store_si128(reinterpret_cast<__m128i *>(cellZ), _mm_cvttps_epi32(z0));
+
+            for (int lane = 0; lane < 4; ++lane) {
+                const float *corner = data + (size_t)cellZ[lane] * rowLength + cellX[lane];
+                h00[lane] = corner[0];
+                h10[lane] = corner[1];
+                h01[lane] = corner[rowLength];
+                h11[lane] = corner[rowLength + 1];
+            }
+
+            __m128 tx = _mm_sub_ps(x, x0);
+            __m128 tz = _mm_sub_ps(z, z0);
+            __m128 top = _mm_load_ps(h00), bottom = _mm_load_ps(h01);
+            __m128 h0 = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(h10), top), tx));
+            __m128 h1 = _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(h11), bottom), tx));
+            __m128 height = _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(h1, h0), tz));
+            _mm_storeu_ps(heights + i, _mm_mul_ps(height, scale));
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        heights[i] = getHeightAt(positions[i].x, positions[i].y);
+    }
+}
+
+#ifdef TERRAIN_BENCHMARK
+void Terrain::benchmarkHeightQueries(size_t count) const {
+    // Random points, some off the grid to exercise the clamping
+    std::vector<glm::vec2> positions(count);
+    std::vector<float> scalarHeights(count), batchHeights(count);
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> randomX(-8.0f, (float)terrainWidth + 8.0f);
+    std::uniform_real_distribution<float> randomZ(-8.0f, (float)terrainHeight + 8.0f);
+    for (auto &position : positions) {
+        position = glm::vec2(randomX(rng), randomZ(rng));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        scalarHeights[i] = getHeightAt(positions[i].x, positions[i].y);
+    }
+    auto scalarEnd = std::chrono::steady_clock::now();
+    getHeightsAt(positions.data(), batchHeights.data(), count);
+    auto batchEnd = std::chrono::steady_clock::now();
+
+    float maxError = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        maxError = std::max(maxError, std::abs(scalarHeights[i] - batchHeights[i]));
+    }
+    double scalarSeconds = std::chrono::duration<double>(scalarEnd - start).count();
+    double batchSeconds = std::chrono::duration<double>(batchEnd - scalarEnd).count();
+    std::cout << "Height queries (" << count << "): scalar " << count / scalarSeconds / 1e6 << " M/s, batched "
+              << count / batchSeconds / 1e6 << " M/s, max difference " << maxError << std::endl;
+}
+#endif
+
+glm::vec3 Terrain::getNormalAt(float x, float z) const {
+    if (streamer) {
+        glm::vec3 normal;
+        return streamer->getNormalAt(x, z, normal) ? normal : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+    x = glm::clamp(x, 0.0f, (float)(heightmapWidth - 1));
+    z = glm::clamp(z, 0.0f, (float)(heightmapHeight - 1));
+    int x0 = static_cast<int>(x);
+    int z0 = static_cast<int>(z);
+    int x1 = std::min(x0 + 1, heightmapWidth - 1);
+    int z1 = std::min(z0 + 1, heightmapHeight - 1);
+
+    glm::vec3 n00 = TerrainNormals::unpack(normalData[z0 * heightmapWidth + x0]);
+    glm::vec3 n10 = TerrainNormals::unpack(normalData[z0 * heightmapWidth + x1]);
+    glm::vec3 n01 = TerrainNormals::unpack(normalData[z1 * heightmapWidth + x0]);
+    glm::vec3 n11 = TerrainNormals::unpack(normalData[z1 * heightmapWidth + x1]);
+
+    float tx = x - x0;
+    float tz = z - z0;
+    return glm::normalize(glm::mix(glm::mix(n00, n10, tx), glm::mix(n01, n11, tx), tz));
+}
+
+glm::vec2 Terrain::getGradientAt(float x, float z) const {
+    // The normal is (-dh/dx, 1, -dh/dz) normalized
+    glm::vec3 normal = getNormalAt(x, z);
+    float ny = std::max(normal.y, 1e-3f);
+    return glm::vec2(-normal.x / ny, -normal.z / ny);
+}
+
+float Terrain::getSlopeAt(float x, float z) const {
+    return glm::length(getGradientAt(x, z));
+}
+
+bool Terrain::deform(const glm::vec3 &center, float radius, float delta) {
+    if (streamer) {
+        std::cerr << "Cannot deform streamed terrain" << std::endl;
+        return false;
+    }
+    if (heightmapData.empty() || radius <= 0.0f || terrainScale <= 0.0f) {
+        return false;
+    }
+
+    // Samples under the circle, as a half-open rectangle
+    int x0 = std::max((int)std::floor(center.x - radius), 0);
+    int z0 = std::max((int)std::floor(center.z - radius), 0);
+    int x1 = std::min((int)std::ceil(center.x + radius) + 1, heightmapWidth);
+    int z1 = std::min((int)std::ceil(center.z + radius) + 1, heightmapHeight);
+    if (x0 >= x1 || z0 >= z1) {
+        return false;
+    }
+
+    if (pristineHeights.empty()) {
+        pristineHeights = heightmapData; // For resetDeformations; only maps that get edited pay for the copy
+    }
+
+    // Smooth bowl (or mound): full delta at the center, falling to zero with zero slope at the rim
+    float normalizedDelta = delta / terrainScale;
+    for (int z = z0; z < z1; ++z) {
+        for (int x = x0; x < x1; ++x) {
+            float dx = x - center.x, dz = z - center.z;
+            float distance2 = (dx * dx + dz * dz) / (radius * radius);
+            if (distance2 >= 1.0f) {
+                continue;
+            }
+            float falloff = (1.0f - distance2) * (1.0f - distance2);
+            float &height = heightmapData[(size_t)z * heightmapWidth + x];
+            height = glm::clamp(height + normalizedDelta * falloff, 0.0f, 1.0f);
+        }
+    }
+
+    updateRegion(x0, z0, x1, z1);
+    reseatObjects(x0, z0, x1, z1);
+    return true;
+}
+
+bool Terrain::resetDeformations() {
+    if (pristineHeights.empty()) {
+        return false;
+    }
+    heightmapData.swap(pristineHeights);
+    std::vector<float>().swap(pristineHeights);
+    updateRegion(0, 0, heightmapWidth, heightmapHeight);
+    reseatObjects(0, 0, heightmapWidth, heightmapHeight);
+    return true;
+}
+
+void Terrain::reseatObjects(int x0, int z0, int x1, int z1) {
+    if (objects.empty()) {
+        return;
+    }
+    // Heights between samples blend their neighbours, so objects up to one unit outside the
+    // changed samples move too
+    glm::vec2 minXZ((float)(x0 - 1), (float)(z0 - 1)), maxXZ((float)x1, (float)z1);
+    std::vector<uint32_t> moved;
+    objectGrid.queryRect(minXZ, maxXZ, moved);
+    size_t kept = 0;
+    for (uint32_t object : moved) {
+        glm::vec3 &position = objects.positions[object];
+        float height = getHeightAt(position.x, position.z);
+        if (height == position.y) {
+            continue;
+        }
+        position.y = height;
+        updateObjectTransforms(object, object + 1);
+        objectGrid.setHeight(object, position);
+        moved[kept++] = object;
+    }
+    moved.resize(kept);
+    if (moved.empty()) {
+        return;
+    }
+    objectGrid.refit(objects.boundsMin, objects.boundsMax, minXZ, maxXZ);
+    if (gpuCuller && !gpuCullerDirty) {
+        gpuCuller->updateInstances(*this, moved);
+    }
+}
+
+void Terrain::updateRegion(int x0, int z0, int x1, int z1) {
+    // Normals read one sample around each texel, so they change one texel further out
+    int nx0 = std::max(x0 - 1, 0), nz0 = std::max(z0 - 1, 0);
+    int nx1 = std::min(x1 + 1, heightmapWidth), nz1 = std::min(z1 + 1, heightmapHeight);
+    TerrainNormals::bakeRegion(heightmapData.data(), heightmapWidth, heightmapHeight, terrainScale, nx0, nz0, nx1, nz1,
+                               normalData.data());
+
+    if (heightPyramid) {
+        heightPyramid->update(x0, z0, x1, z1);
+    }
+    if (quadtree) {
+        quadtree->updateHeights(*this, x0, z0, x1, z1);
+    }
+
+    // Chunk bounds, and in Mesh mode the changed rows of each touched chunk's vertex block
+    if (terrainVAO != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
+    }
+    std::vector<TerrainVertex> rows;
+    for (auto &chunk : chunks) {
+        int chunkX = (int)chunk.minCorner.x, chunkZ = (int)chunk.minCorner.z;
+        int endX = (int)chunk.maxCorner.x, endZ = (int)chunk.maxCorner.z;
+        if (endX < nx0 || chunkX >= nx1 || endZ < nz0 || chunkZ >= nz1) {
+            continue;
+        }
+
+        chunk.minCorner.y = FLT_MAX;
+        chunk.maxCorner.y = -FLT_MAX;
+        for (int z = chunkZ; z <= endZ; ++z) {
+            for (int x = chunkX; x <= endX; ++x) {
+                float height = getHeightAt(x, z);
+                chunk.minCorner.y = glm::min(chunk.minCorner.y, height);
+                chunk.maxCorner.y = glm::max(chunk.maxCorner.y, height);
+            }
+        }
+
+        if (terrainVAO != 0) {
+            // Whole rows keep the update one contiguous range of the chunk's block
+            int rowBegin = std::max(nz0, chunkZ), rowEnd = std::min(nz1 - 1, endZ);
+            int rowLength = endX - chunkX + 1;
+            rows.clear();
+            for (int z = rowBegin; z <= rowEnd; ++z) {
+                for (int x = chunkX; x <= endX; ++x) {
+                    rows.push_back(makeVertex(x, z, chunkX, chunkZ));
+                }
+            }
+            GLintptr offset = (GLintptr)(chunk.baseVertex + (rowBegin - chunkZ) * rowLength) * sizeof(TerrainVertex);
+            glBufferSubData(GL_ARRAY_BUFFER, offset, rows.size() * sizeof(TerrainVertex), rows.data());
+        }
+    }
+    minCorner.y = FLT_MAX;
+    maxCorner.y = -FLT_MAX;
+    for (const auto &chunk : chunks) {
+        minCorner.y = glm::min(minCorner.y, chunk.minCorner.y);
+        maxCorner.y = glm::max(maxCorner.y, chunk.maxCorner.y);
+    }
+
+    // Texture sub-rectangles straight out of the CPU arrays
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, heightmapWidth);
+    if (heightTextureID != 0) {
+        // Converted to the texture's R16 or R32F format by the driver
+        glBindTexture(GL_TEXTURE_2D, heightTextureID);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x0, z0, x1 - x0, z1 - z0, GL_RED, GL_FLOAT,
+                        heightmapData.data() + (size_t)z0 * heightmapWidth + x0);
+    }
+    if (normalTextureID != 0) {
+        glBindTexture(GL_TEXTURE_2D, normalTextureID);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, nx0, nz0, nx1 - nx0, nz1 - nz0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV,
+                        normalData.data() + (size_t)nz0 * heightmapWidth + nx0);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+bool Terrain::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+                      float &hitDistance) const {
+    return heightPyramid && heightPyramid->raycast(origin, direction, maxDistance, hitDistance);
+}
+
+bool Terrain::sphereCast(const glm::vec3 &origin, const glm::vec3 &direction, float radius, float maxDistance,
+                         float &hitDistance) const {
+    return heightPyramid && heightPyramid->sphereCast(origin, direction, radius, maxDistance, hitDistance);
+}
+
+bool Terrain::bakeTiles(const std::string &directory, int tileSize) const {
+    if (heightmapData.empty()) {
+        std::cerr << "No heightmap loaded to bake tiles from" << std::endl;
+        return false;
+    }
+    return TerrainStreamer::bakeTiles(heightmapData.data(), heightmapWidth, heightmapHeight, tileSize, directory);
+}
+
+void Terrain::updateStreaming(const glm::vec3 &focusPosition, bool waitForTiles) {
+    if (!streamer) {
+        return;
+    }
+    if (waitForTiles) {
+        streamer->waitForTiles(focusPosition);
+    } else {
+        streamer->update(focusPosition);
+    }
+}
+
+void Terrain::addModel(const std::string &type, const std::string &modelPath, bool blended) {
+    int typeId = findObjectType(type);
+    if (typeId < 0) {
+        typeId = (int)objectTypes.size();
+        objectTypeIds[type] = (uint16_t)typeId;
+        objectTypes.emplace_back();
+        objectTypes.back().name = type;
+    }
     Model model(modelPath); // Assuming Model is a class for loading and managing 3D models
-    models[type].push_back(model);
+    ObjectType &objectType = objectTypes[typeId];
+    objectType.models.push_back(model);
+    objectType.modelBatches.push_back(-1);
+    if (blended) {
+        objectType.blended = true;
+        hasBlendedObjects = true;
+    }
+    gpuCullerDirty = true;
+}
+
+int Terrain::findObjectType(const std::string &type) const {
+    auto id = objectTypeIds.find(type);
+    return id == objectTypeIds.end() ? -1 : id->second;
 }
 
 void Terrain::generateObjects(int count, const std::string &type,
                               float minHeight, float maxHeight, float spread,
                               float minScale, float maxScale) {
-    for (int i = 0; i < count; ++i) {
-        // Generate random position on the terrain
-        float x = static_cast<float>(rand() % terrainWidth);
-        float z = static_cast<float>(rand() % terrainHeight);
-        float y = getHeightAt(x, z);
+    ObjectPlacementRules rules;
+    rules.count = count;
+    rules.minSpacing = spread;
+    rules.minHeight = minHeight;
+    rules.maxHeight = maxHeight;
+    rules.minScale = minScale;
+    rules.maxScale = maxScale;
+    rules.seed = (uint64_t)rand(); // Seeded by the caller, so a session still varies
+    placeObjects(type, rules);
+}
+
+int Terrain::placeObjects(const std::string &type, const ObjectPlacementRules &rules) {
+    int typeId = findObjectType(type);
+    if (typeId < 0) {
+        std::cerr << "No models loaded for object type: " << type << std::endl;
+        return 0;
+    }
+
+    // Optional density mask, stretched over the whole terrain
+    int maskWidth = 0, maskHeight = 0, maskChannels = 0;
+    unsigned char *mask = nullptr;
+    if (!rules.densityMaskPath.empty()) {
+        mask = stbi_load(rules.densityMaskPath.c_str(), &maskWidth, &maskHeight, &maskChannels, 1);
+        if (!mask) {
+            std::cerr << "Failed to load density mask: " << rules.densityMaskPath << std::endl;
+            return 0;
+        }
+    }
+
+    float width = (float)(terrainWidth - 1), depth = (float)(terrainHeight - 1);
+    auto accept = [&](float x, float z, float &height, float &keepProbability) {
+        if (streamer) {
+            if (!streamer->getHeightAt(x, z, height)) {
+                return false; // Streamed terrain: only place objects where heights are known
+            }
+        } else {
+            height = getHeightAt(x, z);
+        }
+        if (height < rules.minHeight || height > rules.maxHeight || getSlopeAt(x, z) > rules.maxSlope) {
+            return false;
+        }
+        if (mask) {
+            int maskX = std::min((int)(x / width * maskWidth), maskWidth - 1);
+            int maskZ = std::min((int)(z / depth * maskHeight), maskHeight - 1);
+            keepProbability = mask[(size_t)maskZ * maskWidth + maskX] / 255.0f;
+        }
+        return true;
+    };
+    std::vector<glm::vec3> positions = ObjectPlacer::place(width, depth, rules.count, rules.minSpacing, rules.seed, accept);
+    if (mask) {
+        stbi_image_free(mask);
+    }
+
+    if (objects.empty()) {
+        objectGrid.reset((float)terrainWidth, (float)terrainHeight);
+    }
+    size_t first = objects.size(), last = first + positions.size();
+    objects.positions.insert(objects.positions.end(), positions.begin(), positions.end());
+    objects.rotations.resize(last);
+    objects.scales.resize(last);
+    objects.batches.resize(last);
+    uint32_t modelCount = (uint32_t)objectTypes[typeId].models.size();
+    for (size_t i = first; i < last; ++i) {
+        // A stream per object, so its look does not depend on how many came before
+        Pcg32 random(rules.seed ^ 0x9e3779b97f4a7c15ull, i - first);
+        objects.rotations[i] = random.nextFloat() * 6.28318531f;
+        objects.scales[i] = rules.minScale + random.nextFloat() * (rules.maxScale - rules.minScale);
+        objects.batches[i] = getObjectBatch((uint16_t)typeId, (uint16_t)(random.next() % modelCount));
+    }
+    updateObjectTransforms(first, last);
+    for (size_t i = first; i < last; ++i) {
+        objectGrid.insert((uint32_t)i, objects.positions[i], objects.boundsMin[i], objects.boundsMax[i]);
+    }
+    gpuCullerDirty = true;
+    return (int)positions.size();
+}
+
+uint16_t Terrain::getObjectBatch(uint16_t typeId, uint16_t modelIndex) {
+    ObjectType &objectType = objectTypes[typeId];
+    if (objectType.modelBatches[modelIndex] >= 0) {
+        return (uint16_t)objectType.modelBatches[modelIndex];
+    }
+    uint32_t batchIndex = (uint32_t)objectBatches.size();
+    objectType.modelBatches[modelIndex] = (int)batchIndex;
 
-        // Only place the object if it falls within the height range
-        if (y >= minHeight && y <= maxHeight) {
-            // Random rotation (0 to 360 degrees)
-            float rotationY = static_cast<float>(rand() % 360);
+    // Any rotation about Y stays inside the circle around the footprint
+    const Model &model = objectType.models[modelIndex];
+    glm::vec3 localMin = model.GetBoundsMin(), localMax = model.GetBoundsMax();
+    float footprintRadius = std::sqrt(std::max(localMin.x * localMin.x, localMax.x * localMax.x) +
+                                      std::max(localMin.z * localMin.z, localMax.z * localMax.z));
+    // A single object shader, so texture then batch decide the order
+    uint64_t stateKey = DrawSort::stateKey(0, model.GetTextureID(), batchIndex);
+    objectBatches.push_back(ObjectBatch{typeId, modelIndex, {}, objectType.blended, stateKey, footprintRadius,
+                                        localMin.y, localMax.y, {}, {}});
+    if (!objectType.blended) {
+        opaqueBatchOrder.insert(std::upper_bound(opaqueBatchOrder.begin(), opaqueBatchOrder.end(), batchIndex,
+                                                 [&](uint32_t a, uint32_t b) {
+                                                     return objectBatches[a].stateKey < objectBatches[b].stateKey;
+                                                 }),
+                                batchIndex);
+    }
+    return (uint16_t)batchIndex;
+}
 
-            // Random scaling within the specified range
-            float scale = minScale + static_cast<float>(rand()) / RAND_MAX * (maxScale - minScale);
+void Terrain::updateObjectTransforms(size_t first, size_t last) {
+    objects.transforms.resize(objects.size());
+    objects.boundsMin.resize(objects.size());
+    objects.boundsMax.resize(objects.size());
+    const glm::vec3 *positions = objects.positions.data();
+    const float *rotations = objects.rotations.data(), *scales = objects.scales.data();
+    const uint16_t *batches = objects.batches.data();
+    glm::mat4 *transforms = objects.transforms.data();
+    glm::vec3 *boundsMin = objects.boundsMin.data(), *boundsMax = objects.boundsMax.data();
+    // translate * rotateY * scale written out per column: no matrix products, no branches.
+    // The spare bottom row carries the wind amplitude and inverse height of the instance
+    // (see model_instanced.vs); the dither slot [0][3] is left to the LOD pass.
+    for (size_t i = first; i < last; ++i) {
+        float scale = scales[i];
+        float cosine = std::cos(rotations[i]) * scale, sine = std::sin(rotations[i]) * scale;
+        const ObjectBatch &batch = objectBatches[batches[i]];
+        float height = std::max(scale * batch.top, 1e-3f);
+        float windAmplitude = objectTypes[batch.typeId].sway * height;
+        transforms[i][0] = glm::vec4(cosine, 0.0f, -sine, 0.0f);
+        transforms[i][1] = glm::vec4(0.0f, scale, 0.0f, windAmplitude);
+        transforms[i][2] = glm::vec4(sine, 0.0f, cosine, 1.0f / height);
+        transforms[i][3] = glm::vec4(positions[i], 1.0f);
 
-            // Randomly select a model from the available models for this type
-            int modelIndex = rand() % models[type].size();
+        // Widened by the largest sway at unit wind (gusts peak at 1.15), so culling keeps swaying tops
+        float radius = scale * batch.footprintRadius + 1.15f * windAmplitude;
+        boundsMin[i] = glm::vec3(positions[i].x - radius, positions[i].y + scale * batch.bottom, positions[i].z - radius);
+        boundsMax[i] = glm::vec3(positions[i].x + radius, positions[i].y + scale * batch.top, positions[i].z + radius);
+    }
+}
+
+bool Terrain::setObjectLod(const std::string &type, float simplifiedDistance, float impostorDistance) {
+    int typeId = findObjectType(type);
+    if (typeId < 0 || objectTypes[typeId].blended) {
+        std::cerr << "Object LOD needs loaded opaque models of type: " << type << std::endl;
+        return false;
+    }
 
-            // Add the object to the list
-            objects.push_back({glm::vec3(x, y, z), modelIndex, type, rotationY, scale});
+    ObjectType &objectType = objectTypes[typeId];
+    ObjectLod &lod = objectType.lod;
+    lod = ObjectLod();
+    lod.simplifiedDistance = simplifiedDistance;
+    lod.impostorDistance = impostorDistance;
+    Shader bakeShader("shaders/model.vs", "shaders/model.fs");
+    for (auto &model : objectType.models) {
+        if (simplifiedDistance > 0.0f) {
+            lod.simplified.push_back(model.Simplified(OBJECT_LOD_SIMPLIFY_CELL));
+        }
+        if (impostorDistance > 0.0f) {
+            lod.impostors.emplace_back(new Impostor());
+            if (!lod.impostors.back()->bake(model, bakeShader)) {
+                lod.impostorDistance = 0.0f; // Fall back to the meshes at every distance
+            }
+        }
+    }
+    glDeleteProgram(bakeShader.ID);
+
+    objectType.hasLod = true;
+    gpuCullerDirty = true;
+    std::cout << "Object LOD for " << type << ": simplified from " << lod.simplifiedDistance << ", impostors from "
+              << lod.impostorDistance << std::endl;
+    return true;
+}
+
+bool Terrain::setObjectSway(const std::string &type, float sway) {
+    int typeId = findObjectType(type);
+    if (typeId < 0) {
+        std::cerr << "No models loaded for object type: " << type << std::endl;
+        return false;
+    }
+    objectTypes[typeId].sway = sway;
+    // Only this type's matrices and bounds change; the grid cells holding them are refit
+    // to the new bounds and the GPU instances rewritten in place
+    std::vector<uint32_t> changed;
+    glm::vec2 minXZ(FLT_MAX), maxXZ(-FLT_MAX);
+    for (uint32_t object = 0; object < (uint32_t)objects.size(); ++object) {
+        if (objectBatches[objects.batches[object]].typeId != typeId) {
+            continue;
+        }
+        updateObjectTransforms(object, object + 1);
+        const glm::vec3 &position = objects.positions[object];
+        minXZ = glm::min(minXZ, glm::vec2(position.x, position.z));
+        maxXZ = glm::max(maxXZ, glm::vec2(position.x, position.z));
+        changed.push_back(object);
+    }
+    if (changed.empty()) {
+        return true;
+    }
+    objectGrid.refit(objects.boundsMin, objects.boundsMax, minXZ, maxXZ);
+    if (gpuCuller && !gpuCullerDirty) {
+        gpuCuller->updateInstances(*this, changed);
+    }
+    return true;
+}
+
+void Terrain::addLodInstance(ObjectBatch &batch, uint32_t object, float distance) {
+    const ObjectLod &lod = objectTypes[batch.typeId].lod;
+    // Levels: 0 full model, 1 simplified, 2 impostor. Level i starts at edges[i - 1].
+    const float edges[2] = {lod.simplifiedDistance, lod.impostorDistance};
+    int level = 0, previousLevel = 0;
+    for (int i = 0; i < 2; ++i) {
+        if (edges[i] > 0.0f && distance >= edges[i]) {
+            previousLevel = level;
+            level = i + 1;
+        }
+    }
+    float fade = level > 0 ? (distance - edges[level - 1]) / (OBJECT_LOD_FADE * edges[level - 1]) : 1.0f;
+
+    // Dither values: the outgoing level keeps the pixels whose threshold is at least `fade`,
+    // the incoming level (stored negated) the others
+    auto add = [&](int addLevel, float dither) {
+        if (addLevel == 2) {
+            batch.impostorInstances.push_back(
+                {glm::vec4(objects.positions[object], objects.scales[object]),
+                 glm::vec4(objects.rotations[object], dither, objects.transforms[object][1][3],
+                           objects.transforms[object][2][3])});
+            return;
+        }
+        glm::mat4 transform = objects.transforms[object];
+        transform[0][3] = dither; // Unused row of the affine matrix, read by model_instanced.vs
+        (addLevel == 1 ? batch.simplifiedTransforms : batch.transforms).push_back(transform);
+    };
+    if (fade >= 1.0f) {
+        add(level, 0.0f);
+    } else {
+        add(previousLevel, fade);
+        if (fade > 0.0f) {
+            add(level, -fade);
         }
     }
 }
 
-void Terrain::renderObjects(Shader &objectShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition) {
+void Terrain::renderObjects(Shader &objectShader, Shader &impostorShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition) {
+    if (gpuCullerDirty) {
+        gpuCullerDirty = false;
+        gpuCuller.reset();
+        if (GpuObjectCuller::isSupported() && !objects.empty()) {
+            gpuCuller.reset(new GpuObjectCuller());
+            if (!gpuCuller->build(*this)) {
+                std::cerr << "GPU object culling unavailable, culling on the CPU" << std::endl;
+                gpuCuller.reset();
+            }
+        }
+    }
+    // Opaque and alpha-tested objects draw with blending off: with it on, texels that pass the
+    // alpha test but are not fully opaque would blend with whatever happened to be drawn first
+    GLboolean blendEnabled = glIsEnabled(GL_BLEND);
+    glDisable(GL_BLEND);
+
+    // The GPU path draws every opaque object; the CPU walk below is then only needed for blended ones
+    if (gpuCuller) {
+        // Horizon culling as in the CPU walk, with the horizon rasterized in distance bands
+        // since the GPU tests every object at once
+        horizonLimits.clear();
+        if (heightPyramid) {
+            horizonCuller.begin(*heightPyramid, cameraPosition);
+            horizonCuller.rasterizeBands(horizonLimits, horizonBands);
+        }
+        gpuCuller->render(objectShader, impostorShader, vp, cameraPosition, horizonLimits, horizonBands);
+        if (!hasBlendedObjects) {
+            if (blendEnabled) {
+                glEnable(GL_BLEND);
+            }
+            return;
+        }
+    }
+
     objectShader.use();
+    objectShader.setMat4("viewProjection", vp);
+
+    // Only cells in the frustum are visited, nearest first as the horizon culler needs.
+    // Objects are tested against the horizon as rasterized up to their cell, which is
+    // conservative since they lie no nearer than the cell's box.
+    Frustum frustum(vp);
+    objectGrid.selectVisible(frustum, cameraPosition, visibleObjectCells);
+    if (heightPyramid) {
+        horizonCuller.begin(*heightPyramid, cameraPosition);
+    }
+    for (auto &batch : objectBatches) {
+        batch.transforms.clear();
+        batch.simplifiedTransforms.clear();
+        batch.impostorInstances.clear();
+    }
+    blendedObjectKeys.clear();
+    for (const ObjectGrid::Cell *cell : visibleObjectCells) {
+        if (heightPyramid) {
+            horizonCuller.rasterizeTo(horizonCuller.getNearDistance(cell->boundsMin, cell->boundsMax));
+            if (horizonCuller.isOccluded(cell->boundsMin, cell->boundsMax)) {
+                continue;
+            }
+        }
+        for (uint32_t index : cell->items) {
+            ObjectBatch &batch = objectBatches[objects.batches[index]];
+            if (gpuCuller && !batch.blended) {
+                continue;
+            }
+            if (!frustum.intersectsBox(objects.boundsMin[index], objects.boundsMax[index]) ||
+                (heightPyramid && horizonCuller.isOccluded(objects.boundsMin[index], objects.boundsMax[index]))) {
+                continue;
+            }
+            if (batch.blended) {
+                glm::vec3 offset = objects.positions[index] - cameraPosition;
+                blendedObjectKeys.push_back(DrawSort::backToFrontKey(glm::dot(offset, offset), index));
+            } else if (objectTypes[batch.typeId].hasLod) {
+                addLodInstance(batch, index, glm::distance(objects.positions[index], cameraPosition));
+            } else {
+                batch.transforms.push_back(objects.transforms[index]);
+            }
+        }
+    }
+
+    // Opaque and alpha-tested: one instanced draw per mesh of each model, in state order so
+    // batches sharing a texture follow each other. Each mesh binds its own textures.
+    for (uint32_t batchIndex : opaqueBatchOrder) {
+        ObjectBatch &batch = objectBatches[batchIndex];
+        if (batch.transforms.empty() && batch.simplifiedTransforms.empty()) {
+            continue;
+        }
 
-    // Sort objects by distance to the camera (farthest first)
-    std::sort(objects.begin(), objects.end(), [&](const ObjectInstance &a, const ObjectInstance &b) {
-        float distA = glm::distance(cameraPosition, a.position);
-        float distB = glm::distance(cameraPosition, b.position);
-        return distA > distB; // Farthest first
-    });
+        ObjectType &objectType = objectTypes[batch.typeId];
+        Model &model = objectType.models[batch.modelIndex];
+        model.DrawInstanced(objectShader, batch.transforms.data(), batch.transforms.size());
+        if (!batch.simplifiedTransforms.empty()) {
+            objectType.lod.simplified[batch.modelIndex].DrawInstanced(objectShader, batch.simplifiedTransforms.data(),
+                                                                      batch.simplifiedTransforms.size());
+        }
+    }
 
-    for (const auto &object : objects) {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, object.position);
+    // Impostor level: camera-facing quads from the baked atlases
+    bool impostorShaderBound = false;
+    for (auto &batch : objectBatches) {
+        if (batch.impostorInstances.empty()) {
+            continue;
+        }
+        if (!impostorShaderBound) {
+            impostorShader.use();
+            impostorShader.setMat4("viewProjection", vp);
+            impostorShader.setVec3("cameraPosition", cameraPosition);
+            impostorShaderBound = true;
+        }
+        objectTypes[batch.typeId].lod.impostors[batch.modelIndex]->drawInstanced(
+            impostorShader, batch.impostorInstances.data(), batch.impostorInstances.size());
+    }
+    if (impostorShaderBound) {
+        objectShader.use();
+    }
+    if (blendEnabled) {
+        glEnable(GL_BLEND);
+    }
 
-        // Apply random rotation around the Y-axis
-        model = glm::rotate(model, glm::radians(object.rotationY), glm::vec3(0.0f, 1.0f, 0.0f));
+    // Blended: back to front, consecutive objects of the same model merged into one instanced draw
+    if (blendedObjectKeys.empty()) {
+        return;
+    }
+    DrawSort::radixSort(blendedObjectKeys, sortScratch);
+    glDepthMask(GL_FALSE);
+    for (size_t first = 0; first < blendedObjectKeys.size();) {
+        uint16_t batchIndex = objects.batches[DrawSort::payload(blendedObjectKeys[first])];
+        ObjectBatch &batch = objectBatches[batchIndex];
+        size_t last = first;
+        for (; last < blendedObjectKeys.size(); ++last) {
+            uint32_t object = DrawSort::payload(blendedObjectKeys[last]);
+            if (objects.batches[object] != batchIndex) {
+                break;
+            }
+            batch.transforms.push_back(objects.transforms[object]);
+        }
 
-        // Apply random scaling
-        model = glm::scale(model, glm::vec3(object.scale));
+        Model &model = objectTypes[batch.typeId].models[batch.modelIndex];
+        model.DrawInstanced(objectShader, batch.transforms.data(), batch.transforms.size());
+        batch.transforms.clear();
+        first = last;
+    }
+    glDepthMask(GL_TRUE);
+}
 
-        objectShader.setMat4("model", model);
-        objectShader.setMat4("viewProjection", vp);
+void Terrain::queryObjects(const glm::vec3 &center, float radius, std::vector<uint32_t> &result) const {
+    objectGrid.queryRadius(center, radius, result);
+}
 
-        // Explicitly bind the correct texture for this model
-        unsigned int textureID = models[object.type][object.modelIndex].GetTextureID();
-        glActiveTexture(GL_TEXTURE0);              // Use texture unit 0
-        glBindTexture(GL_TEXTURE_2D, textureID);   // Bind the object's texture
-        objectShader.setInt("texture_diffuse", 0); // Ensure shader knows which texture unit to use
+bool Terrain::setGrass(const GrassSettings &settings) {
+    if (streamer || !heightPyramid) {
+        std::cerr << "Grass needs a loaded heightmap" << std::endl;
+        return false;
+    }
+    if (!GrassField::isSupported()) {
+        std::cerr << "Grass needs OpenGL 4.3" << std::endl;
+        return false;
+    }
+    if (heightTextureID == 0) {
+        setupHeightTexture(); // Mesh mode draws without one; deform keeps it current from now on
+    }
+    grassField.reset(new GrassField(settings));
+    return true;
+}
 
-        // Render the selected model
-        models[object.type][object.modelIndex].Draw(objectShader);
+void Terrain::renderGrass(Shader &grassShader, const glm::mat4 &vp, const glm::vec3 &cameraPosition, const glm::vec2 &wind) {
+    if (grassField) {
+        grassField->render(*this, grassShader, vp, cameraPosition, wind);
     }
 }
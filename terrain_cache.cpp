@@ -0,0 +1,221 @@
+#include "lib/terrain_cache.h"
+#include "lib/mapped_file.h"
+#include "lib/terrain.h"
+#include "lib/terrain_generator.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const char kMagic[4] = {'T', 'R', 'N', 'C'};
+const uint32_t kVersion = 1; // Bump with any change to the file layout or the cooked structs
+
+struct CookedHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    int32_t heightmapWidth, heightmapHeight, heightmapBits;
+    int32_t terrainWidth, terrainHeight;
+    float minCorner[3], maxCorner[3];
+    uint64_t chunkCount, vertexCount, indexCount, pyramidRangeCount;
+};
+
+// Sections start 8-byte aligned so the mapped blobs can be read in place
+size_t alignSection(size_t offset) {
+    return (offset + 7) & ~(size_t)7;
+}
+
+// FNV-1a over 64-bit words (bytes for the tail); a source of tens of megabytes hashes
+// in a few milliseconds, well below the cost of reading it
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+template <typename T>
+uint64_t hashValue(uint64_t hash, const T &value) {
+    return hashBytes(hash, &value, sizeof(value));
+}
+
+} // namespace
+
+bool TerrainCache::computeKey(const std::string &heightmapPath, float scale, int width, int height, bool withMesh,
+                              uint64_t &key) {
+    uint64_t hash = 14695981039346656037ull;
+    if (heightmapPath.compare(0, std::strlen(TERRAIN_PROCEDURAL_PREFIX), TERRAIN_PROCEDURAL_PREFIX) == 0) {
+        hash = hashBytes(hash, heightmapPath.data(), heightmapPath.size()); // The spec is the source
+    } else {
+        if (!std::ifstream(heightmapPath).good()) {
+            return false;
+        }
+        MappedFile source;
+        if (!source.open(heightmapPath)) {
+            return false;
+        }
+        hash = hashBytes(hash, source.data(), source.size());
+    }
+
+    hash = hashValue(hash, kVersion);
+    hash = hashValue(hash, scale);
+    hash = hashValue(hash, width);
+    hash = hashValue(hash, height);
+    hash = hashValue(hash, withMesh);
+    hash = hashValue(hash, TERRAIN_CHUNK_SIZE);
+    hash = hashValue(hash, TERRAIN_STRIP_BAND);
+    hash = hashValue(hash, sizeof(Terrain::TerrainVertex));
+    hash = hashValue(hash, sizeof(Terrain::TerrainChunk));
+    key = hash;
+    return true;
+}
+
+std::string TerrainCache::pathFor(uint64_t key) {
+    std::ostringstream path;
+    path << TERRAIN_CACHE_DIRECTORY << "/terrain_" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+    return path.str();
+}
+
+bool TerrainCache::load(Terrain &terrain, uint64_t key, bool withMesh) {
+    std::string path = pathFor(key);
+    if (!std::ifstream(path).good()) {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+
+    CookedHeader header;
+    if (file.size() < sizeof(header)) {
+        std::cerr << "Ignoring truncated cooked terrain: " << path << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || header.key != key) {
+        std::cerr << "Ignoring stale cooked terrain: " << path << std::endl;
+        return false;
+    }
+
+    size_t sampleCount = (size_t)header.heightmapWidth * header.heightmapHeight;
+    size_t heightsOffset = alignSection(sizeof(header));
+    size_t normalsOffset = alignSection(heightsOffset + sampleCount * sizeof(float));
+    size_t chunksOffset = alignSection(normalsOffset + sampleCount * sizeof(GLuint));
+    size_t verticesOffset = alignSection(chunksOffset + header.chunkCount * sizeof(Terrain::TerrainChunk));
+    size_t indicesOffset = alignSection(verticesOffset + header.vertexCount * sizeof(Terrain::TerrainVertex));
+    size_t pyramidOffset = alignSection(indicesOffset + header.indexCount * sizeof(GLushort));
+    size_t end = alignSection(pyramidOffset + header.pyramidRangeCount * sizeof(glm::vec2));
+    if (end != file.size() || (withMesh && header.vertexCount == 0)) {
+        std::cerr << "Ignoring damaged cooked terrain: " << path << std::endl;
+        return false;
+    }
+    const char *base = static_cast<const char *>(file.data());
+
+    // CPU-side copies for height queries; the mesh goes straight from the mapping to the GPU
+    const float *heights = reinterpret_cast<const float *>(base + heightsOffset);
+    const GLuint *normals = reinterpret_cast<const GLuint *>(base + normalsOffset);
+    const Terrain::TerrainChunk *chunks = reinterpret_cast<const Terrain::TerrainChunk *>(base + chunksOffset);
+    terrain.heightmapData.assign(heights, heights + sampleCount);
+    terrain.normalData.assign(normals, normals + sampleCount);
+    terrain.chunks.assign(chunks, chunks + header.chunkCount);
+    terrain.heightmapWidth = header.heightmapWidth;
+    terrain.heightmapHeight = header.heightmapHeight;
+    terrain.heightmapBits = header.heightmapBits;
+    terrain.terrainWidth = header.terrainWidth;
+    terrain.terrainHeight = header.terrainHeight;
+    terrain.minCorner = glm::vec3(header.minCorner[0], header.minCorner[1], header.minCorner[2]);
+    terrain.maxCorner = glm::vec3(header.maxCorner[0], header.maxCorner[1], header.maxCorner[2]);
+    terrain.heightPyramid.reset(new HeightPyramid(terrain.heightmapData.data(), terrain.heightmapWidth,
+                                                  terrain.heightmapHeight, terrain.terrainScale,
+                                                  reinterpret_cast<const glm::vec2 *>(base + pyramidOffset)));
+    terrain.uploadNormalTexture();
+    if (header.vertexCount > 0) {
+        terrain.uploadTerrainMesh(reinterpret_cast<const Terrain::TerrainVertex *>(base + verticesOffset),
+                                  (size_t)header.vertexCount, reinterpret_cast<const GLushort *>(base + indicesOffset),
+                                  (size_t)header.indexCount);
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Loaded cooked terrain " << path << " (" << (file.size() >> 10) << " KB) in " << elapsed.count()
+              << " ms" << std::endl;
+    return true;
+}
+
+bool TerrainCache::save(const Terrain &terrain, uint64_t key) {
+    if (terrain.heightmapData.empty()) {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(TERRAIN_CACHE_DIRECTORY, error);
+
+    std::vector<glm::vec2> pyramidRanges;
+    if (terrain.heightPyramid) {
+        pyramidRanges = terrain.heightPyramid->getStoredRanges();
+    }
+
+    CookedHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.key = key;
+    header.heightmapWidth = terrain.heightmapWidth;
+    header.heightmapHeight = terrain.heightmapHeight;
+    header.heightmapBits = terrain.heightmapBits;
+    header.terrainWidth = terrain.terrainWidth;
+    header.terrainHeight = terrain.terrainHeight;
+    for (int axis = 0; axis < 3; ++axis) {
+        header.minCorner[axis] = terrain.minCorner[axis];
+        header.maxCorner[axis] = terrain.maxCorner[axis];
+    }
+    header.chunkCount = terrain.chunks.size();
+    header.vertexCount = terrain.vertices.size();
+    header.indexCount = terrain.indices.size();
+    header.pyramidRangeCount = pyramidRanges.size();
+
+    // Written under a temporary name and renamed, so an interrupted write never leaves a file that looks valid
+    std::string path = pathFor(key), tempPath = path + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary);
+    size_t offset = 0;
+    auto writeSection = [&](const void *data, size_t size) {
+        out.write(static_cast<const char *>(data), (std::streamsize)size);
+        static const char padding[8] = {};
+        size_t padded = alignSection(offset + size);
+        out.write(padding, (std::streamsize)(padded - offset - size));
+        offset = padded;
+    };
+    writeSection(&header, sizeof(header));
+    writeSection(terrain.heightmapData.data(), terrain.heightmapData.size() * sizeof(float));
+    writeSection(terrain.normalData.data(), terrain.normalData.size() * sizeof(GLuint));
+    writeSection(terrain.chunks.data(), terrain.chunks.size() * sizeof(Terrain::TerrainChunk));
+    writeSection(terrain.vertices.data(), terrain.vertices.size() * sizeof(Terrain::TerrainVertex));
+    writeSection(terrain.indices.data(), terrain.indices.size() * sizeof(GLushort));
+    writeSection(pyramidRanges.data(), pyramidRanges.size() * sizeof(glm::vec2));
+    out.close();
+
+    if (!out) {
+        std::cerr << "Failed to write cooked terrain: " << tempPath << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::cerr << "Failed to write cooked terrain: " << path << " (" << error.message() << ")" << std::endl;
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    std::cout << "Cooked terrain to " << path << " (" << (offset >> 10) << " KB)" << std::endl;
+    return true;
+}
@@ -0,0 +1,265 @@
+#include "lib/terrain_generator.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+const int kTileSize = 64;         // Noise is filled in square tiles handed out to the workers
+const int kMinRowsPerThread = 32; // Erosion bands below this cost more in thread start-up than they save
+
+int workerCount(int jobs) {
+    return std::max(1, std::min((int)std::max(1u, std::thread::hardware_concurrency()), jobs));
+}
+
+// Run body(rowBegin, rowEnd) over [0, rows) in contiguous bands, one per thread
+template <typename Body>
+void parallelRows(int rows, const Body &body) {
+    int threadCount = workerCount(rows / kMinRowsPerThread);
+    if (threadCount == 1) {
+        body(0, rows);
+        return;
+    }
+    std::vector<std::thread> workers;
+    int rowsPerThread = (rows + threadCount - 1) / threadCount;
+    for (int rowBegin = 0; rowBegin < rows; rowBegin += rowsPerThread) {
+        workers.emplace_back(body, rowBegin, std::min(rowBegin + rowsPerThread, rows));
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+uint32_t hashLattice(int x, int z, uint32_t seed) {
+    uint32_t h = seed * 0x9E3779B9u ^ (uint32_t)x * 0x85EBCA6Bu ^ (uint32_t)z * 0xC2B2AE35u;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// One of eight lattice gradients, picked by the hash, dotted with the offset to the sample
+float gradientDot(uint32_t hash, float dx, float dz) {
+    static const float gradientX[8] = {1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f, 0.0f, 0.0f};
+    static const float gradientZ[8] = {1.0f, -1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, -1.0f};
+    return gradientX[hash & 7] * dx + gradientZ[hash & 7] * dz;
+}
+
+// 2D gradient noise, roughly in [-1, 1]
+float gradientNoise(float x, float z, uint32_t seed) {
+    float fx = std::floor(x), fz = std::floor(z);
+    int ix = (int)fx, iz = (int)fz;
+    float dx = x - fx, dz = z - fz;
+    float u = dx * dx * dx * (dx * (dx * 6.0f - 15.0f) + 10.0f); // Quintic fade
+    float v = dz * dz * dz * (dz * (dz * 6.0f - 15.0f) + 10.0f);
+
+    float n00 = gradientDot(hashLattice(ix, iz, seed), dx, dz);
+    float n10 = gradientDot(hashLattice(ix + 1, iz, seed), dx - 1.0f, dz);
+    float n01 = gradientDot(hashLattice(ix, iz + 1, seed), dx, dz - 1.0f);
+    float n11 = gradientDot(hashLattice(ix + 1, iz + 1, seed), dx - 1.0f, dz - 1.0f);
+    float n0 = n00 + (n10 - n00) * u;
+    float n1 = n01 + (n11 - n01) * u;
+    return n0 + (n1 - n0) * v;
+}
+
+float fbm(float x, float z, uint32_t seed, int octaves, float lacunarity, float gain) {
+    float sum = 0.0f, amplitude = 1.0f;
+    for (int octave = 0; octave < octaves; ++octave) {
+        sum += amplitude * gradientNoise(x, z, seed + (uint32_t)octave * 101u);
+        x *= lacunarity;
+        z *= lacunarity;
+        amplitude *= gain;
+    }
+    return sum;
+}
+
+} // namespace
+
+bool TerrainGenerator::parse(const std::string &spec, TerrainGeneratorSettings &settings) {
+    std::string options = spec.compare(0, std::string(TERRAIN_PROCEDURAL_PREFIX).size(), TERRAIN_PROCEDURAL_PREFIX) == 0
+                              ? spec.substr(std::string(TERRAIN_PROCEDURAL_PREFIX).size())
+                              : spec;
+    std::stringstream stream(options);
+    std::string option;
+    while (std::getline(stream, option, ',')) {
+        if (option.empty()) {
+            continue;
+        }
+        size_t equals = option.find('=');
+        if (equals == std::string::npos) {
+            std::cerr << "Procedural terrain option without a value: " << option << std::endl;
+            return false;
+        }
+        std::string key = option.substr(0, equals);
+        const char *value = option.c_str() + equals + 1;
+        if (key == "seed") {
+            settings.seed = (uint32_t)std::strtoul(value, nullptr, 10);
+        } else if (key == "size") {
+            settings.width = settings.height = std::atoi(value);
+        } else if (key == "width") {
+            settings.width = std::atoi(value);
+        } else if (key == "height") {
+            settings.height = std::atoi(value);
+        } else if (key == "frequency") {
+            settings.frequency = (float)std::atof(value);
+        } else if (key == "octaves") {
+            settings.octaves = std::atoi(value);
+        } else if (key == "lacunarity") {
+            settings.lacunarity = (float)std::atof(value);
+        } else if (key == "gain") {
+            settings.gain = (float)std::atof(value);
+        } else if (key == "ridged") {
+            settings.ridged = (float)std::atof(value);
+        } else if (key == "warp") {
+            settings.warp = (float)std::atof(value);
+        } else if (key == "erosion") {
+            settings.erosion = std::atoi(value);
+        } else if (key == "talus") {
+            settings.talus = (float)std::atof(value);
+        } else {
+            std::cerr << "Unknown procedural terrain option: " << key << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+float TerrainGenerator::sample(const TerrainGeneratorSettings &settings, float x, float z) {
+    float frequency = settings.frequency;
+    if (settings.warp > 0.0f) {
+        // Offset the lookup by two low-octave noise fields; bends ridges and valleys
+        float warpX = fbm(x * frequency, z * frequency, settings.seed ^ 0x5bd1e995u, 3, 2.0f, 0.5f);
+        float warpZ = fbm(x * frequency, z * frequency, settings.seed ^ 0x27d4eb2du, 3, 2.0f, 0.5f);
+        x += settings.warp * warpX;
+        z += settings.warp * warpZ;
+    }
+
+    float fx = x * frequency, fz = z * frequency;
+    float smooth = 0.0f, ridges = 0.0f, amplitude = 1.0f, weight = 1.0f;
+    for (int octave = 0; octave < settings.octaves; ++octave) {
+        float n = gradientNoise(fx, fz, settings.seed + (uint32_t)octave * 101u);
+        smooth += amplitude * n;
+        // Ridged: sharp crests where the noise crosses zero, detail damped in the valleys
+        float ridge = 1.0f - std::fabs(n);
+        ridge *= ridge * weight;
+        weight = std::min(std::max(ridge * 2.0f, 0.0f), 1.0f);
+        ridges += amplitude * ridge;
+        fx *= settings.lacunarity;
+        fz *= settings.lacunarity;
+        amplitude *= settings.gain;
+    }
+    return smooth + (ridges - smooth) * settings.ridged;
+}
+
+void TerrainGenerator::generate(const TerrainGeneratorSettings &settings, std::vector<float> &heights) {
+    int width = settings.width, height = settings.height;
+    heights.assign((size_t)std::max(width, 0) * std::max(height, 0), 0.0f);
+    if (heights.empty()) {
+        return;
+    }
+
+    // Tiles are pulled from a shared counter; each sample depends only on its position
+    int tilesX = (width + kTileSize - 1) / kTileSize, tilesZ = (height + kTileSize - 1) / kTileSize;
+    int tileCount = tilesX * tilesZ;
+    int threadCount = workerCount(tileCount);
+    std::atomic<int> nextTile(0);
+    std::vector<float> workerMin(threadCount, FLT_MAX), workerMax(threadCount, -FLT_MAX);
+    auto fillTiles = [&](int worker) {
+        for (int tile = nextTile++; tile < tileCount; tile = nextTile++) {
+            int x0 = (tile % tilesX) * kTileSize, z0 = (tile / tilesX) * kTileSize;
+            for (int z = z0; z < std::min(z0 + kTileSize, height); ++z) {
+                for (int x = x0; x < std::min(x0 + kTileSize, width); ++x) {
+                    float h = sample(settings, (float)x, (float)z);
+                    heights[(size_t)z * width + x] = h;
+                    workerMin[worker] = std::min(workerMin[worker], h);
+                    workerMax[worker] = std::max(workerMax[worker], h);
+                }
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int worker = 1; worker < threadCount; ++worker) {
+        workers.emplace_back(fillTiles, worker);
+    }
+    fillTiles(0);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    float minHeight = *std::min_element(workerMin.begin(), workerMin.end());
+    float maxHeight = *std::max_element(workerMax.begin(), workerMax.end());
+    float invRange = maxHeight > minHeight ? 1.0f / (maxHeight - minHeight) : 0.0f;
+    parallelRows(height, [&](int rowBegin, int rowEnd) {
+        for (size_t i = (size_t)rowBegin * width; i < (size_t)rowEnd * width; ++i) {
+            heights[i] = (heights[i] - minHeight) * invRange;
+        }
+    });
+
+    if (settings.erosion > 0) {
+        erode(settings, heights);
+    }
+}
+
+void TerrainGenerator::erode(const TerrainGeneratorSettings &settings, std::vector<float> &heights) {
+    // Each iteration first works out what every sample sheds to its lower 4-neighbours,
+    // then gathers: the new height is the old one minus outflow plus what the neighbours
+    // shed onto it. Both passes only read the previous state, so bands can run in any order.
+    int width = settings.width, height = settings.height;
+    const int offsetX[4] = {1, -1, 0, 0}, offsetZ[4] = {0, 0, 1, -1}; // Opposite direction: index ^ 1
+    std::vector<float> outflow(heights.size() * 4);
+    std::vector<float> eroded(heights.size());
+
+    for (int iteration = 0; iteration < settings.erosion; ++iteration) {
+        parallelRows(height, [&](int rowBegin, int rowEnd) {
+            for (int z = rowBegin; z < rowEnd; ++z) {
+                for (int x = 0; x < width; ++x) {
+                    size_t index = (size_t)z * width + x;
+                    float h = heights[index];
+                    float drops[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                    float totalDrop = 0.0f, maxDrop = 0.0f;
+                    for (int n = 0; n < 4; ++n) {
+                        int nx = x + offsetX[n], nz = z + offsetZ[n];
+                        if (nx < 0 || nx >= width || nz < 0 || nz >= height) {
+                            continue;
+                        }
+                        float drop = h - heights[(size_t)nz * width + nx];
+                        if (drop > settings.talus) {
+                            drops[n] = drop;
+                            totalDrop += drop;
+                            maxDrop = std::max(maxDrop, drop);
+                        }
+                    }
+                    // Move half the excess over the talus, split by how far each neighbour is below
+                    float moved = totalDrop > 0.0f ? 0.5f * (maxDrop - settings.talus) / totalDrop : 0.0f;
+                    for (int n = 0; n < 4; ++n) {
+                        outflow[index * 4 + n] = drops[n] * moved;
+                    }
+                }
+            }
+        });
+        parallelRows(height, [&](int rowBegin, int rowEnd) {
+            for (int z = rowBegin; z < rowEnd; ++z) {
+                for (int x = 0; x < width; ++x) {
+                    size_t index = (size_t)z * width + x;
+                    const float *out = &outflow[index * 4];
+                    float h = heights[index] - (out[0] + out[1] + out[2] + out[3]);
+                    for (int n = 0; n < 4; ++n) {
+                        int nx = x + offsetX[n], nz = z + offsetZ[n];
+                        if (nx >= 0 && nx < width && nz >= 0 && nz < height) {
+                            h += outflow[((size_t)nz * width + nx) * 4 + (n ^ 1)];
+                        }
+                    }
+                    eroded[index] = h;
+                }
+            }
+        });
+        heights.swap(eroded);
+    }
+}
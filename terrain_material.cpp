@@ -0,0 +1,134 @@
+#include "lib/terrain_material.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stb/stb_image.h>
+
+namespace {
+
+// Bilinear RGBA8 resample, for layers whose size differs from the first one
+std::vector<unsigned char> resampleRGBA(const unsigned char *pixels, int width, int height, int newWidth, int newHeight) {
+    std::vector<unsigned char> resized((size_t)newWidth * newHeight * 4);
+    for (int y = 0; y < newHeight; ++y) {
+        float sy = std::max((y + 0.5f) * height / newHeight - 0.5f, 0.0f);
+        int y0 = std::min((int)sy, height - 1), y1 = std::min(y0 + 1, height - 1);
+        float ty = sy - y0;
+        for (int x = 0; x < newWidth; ++x) {
+            float sx = std::max((x + 0.5f) * width / newWidth - 0.5f, 0.0f);
+            int x0 = std::min((int)sx, width - 1), x1 = std::min(x0 + 1, width - 1);
+            float tx = sx - x0;
+            for (int c = 0; c < 4; ++c) {
+                float top = pixels[((size_t)y0 * width + x0) * 4 + c] * (1.0f - tx) + pixels[((size_t)y0 * width + x1) * 4 + c] * tx;
+                float bottom = pixels[((size_t)y1 * width + x0) * 4 + c] * (1.0f - tx) + pixels[((size_t)y1 * width + x1) * 4 + c] * tx;
+                resized[((size_t)y * newWidth + x) * 4 + c] = (unsigned char)(top + (bottom - top) * ty + 0.5f);
+            }
+        }
+    }
+    return resized;
+}
+
+} // namespace
+
+TerrainMaterial::~TerrainMaterial() {
+    if (arrayTexture != 0) {
+        glDeleteTextures(1, &arrayTexture);
+    }
+    if (weightTexture != 0) {
+        glDeleteTextures(1, &weightTexture);
+    }
+}
+
+bool TerrainMaterial::load(const std::vector<TerrainLayer> &newLayers) {
+    if (newLayers.empty() || newLayers.size() > (size_t)TERRAIN_MAX_SPLAT_LAYERS) {
+        std::cerr << "Terrain material needs 1 to " << TERRAIN_MAX_SPLAT_LAYERS << " layers" << std::endl;
+        return false;
+    }
+
+    int layerWidth = 0, layerHeight = 0;
+    std::vector<std::vector<unsigned char>> layerPixels;
+    for (const auto &layer : newLayers) {
+        int width, height, channels;
+        unsigned char *data = stbi_load(layer.texturePath.c_str(), &width, &height, &channels, 4);
+        if (!data) {
+            std::cerr << "Failed to load terrain layer: " << layer.texturePath << std::endl;
+            std::cerr << "stb_image error: " << stbi_failure_reason() << std::endl;
+            return false;
+        }
+        if (layerPixels.empty()) {
+            layerWidth = width;
+            layerHeight = height;
+        }
+        if (width == layerWidth && height == layerHeight) {
+            layerPixels.emplace_back(data, data + (size_t)width * height * 4);
+        } else {
+            std::cout << "Resampling terrain layer " << layer.texturePath << " from " << width << "x" << height
+                      << " to " << layerWidth << "x" << layerHeight << std::endl;
+            layerPixels.push_back(resampleRGBA(data, width, height, layerWidth, layerHeight));
+        }
+        stbi_image_free(data);
+    }
+
+    if (arrayTexture != 0) {
+        glDeleteTextures(1, &arrayTexture);
+    }
+    int mipLevels = 1 + (int)std::floor(std::log2((float)std::max(layerWidth, layerHeight)));
+    glGenTextures(1, &arrayTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, mipLevels, GL_RGBA8, layerWidth, layerHeight, (GLsizei)layerPixels.size());
+    for (size_t i = 0; i < layerPixels.size(); ++i) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)i, layerWidth, layerHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                        layerPixels[i].data());
+    }
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    layers = newLayers;
+    std::cout << "Terrain material loaded: " << layers.size() << " layers of " << layerWidth << "x" << layerHeight << std::endl;
+    return true;
+}
+
+bool TerrainMaterial::loadWeightMap(const std::string &path) {
+    int width, height, channels;
+    unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (!data) {
+        std::cerr << "Failed to load terrain weight map: " << path << std::endl;
+        std::cerr << "stb_image error: " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+
+    if (weightTexture == 0) {
+        glGenTextures(1, &weightTexture);
+    }
+    glBindTexture(GL_TEXTURE_2D, weightTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    stbi_image_free(data);
+    return true;
+}
+
+void TerrainMaterial::bind(Shader &shader, int unit) const {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+    shader.setInt("splatLayers", unit);
+    shader.setInt("splatLayerCount", (int)layers.size());
+    for (size_t i = 0; i < layers.size(); ++i) {
+        const TerrainLayer &layer = layers[i];
+        std::string index = "[" + std::to_string(i) + "]";
+        shader.setVec4("splatHeightSlope" + index, glm::vec4(layer.heightRange.x, layer.heightRange.y, layer.slopeRange.x, layer.slopeRange.y));
+        shader.setFloat("splatBlend" + index, layer.blend);
+    }
+
+    shader.setBool("useSplatWeightMap", weightTexture != 0);
+    if (weightTexture != 0) {
+        glActiveTexture(GL_TEXTURE0 + unit + 1);
+        glBindTexture(GL_TEXTURE_2D, weightTexture);
+        shader.setInt("splatWeights", unit + 1);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
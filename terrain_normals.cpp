@@ -0,0 +1,148 @@
+#include "lib/terrain_normals.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_NORMALS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Rows per worker below which spawning threads costs more than it saves
+const int kMinRowsPerThread = 64;
+
+// Scale one row of samples to world heights with one clamped texel of padding on both sides
+void convertRow(const float *source, int width, float sampleScale, float *padded) {
+    float *row = padded + 1;
+    int x = 0;
+#ifdef TERRAIN_NORMALS_SSE2
+    const __m128 scale = _mm_set1_ps(sampleScale);
+    for (; x + 4 <= width; x += 4) {
+        _mm_storeu_ps(row + x, _mm_mul_ps(_mm_loadu_ps(source + x), scale));
+    }
+#endif
+    for (; x < width; ++x) {
+        row[x] = source[x] * sampleScale;
+    }
+    padded[0] = row[0];
+    padded[width + 1] = row[width - 1];
+}
+
+} // namespace
+
+GLuint TerrainNormals::pack(const glm::vec3 &normal) {
+    GLuint x = (GLuint)glm::clamp((normal.x * 0.5f + 0.5f) * 1023.0f + 0.5f, 0.0f, 1023.0f);
+    GLuint y = (GLuint)glm::clamp((normal.y * 0.5f + 0.5f) * 1023.0f + 0.5f, 0.0f, 1023.0f);
+    GLuint z = (GLuint)glm::clamp((normal.z * 0.5f + 0.5f) * 1023.0f + 0.5f, 0.0f, 1023.0f);
+    return x | (y << 10) | (z << 20);
+}
+
+glm::vec3 TerrainNormals::unpack(GLuint packed) {
+    return glm::vec3((float)(packed & 1023u), (float)((packed >> 10) & 1023u), (float)((packed >> 20) & 1023u)) *
+               (2.0f / 1023.0f) -
+           glm::vec3(1.0f);
+}
+
+void TerrainNormals::bake(const float *heights, int width, int height, float heightScale,
+                          std::vector<GLuint> &packedNormals) {
+    packedNormals.resize((size_t)width * height);
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    // The Sobel sums weigh 8 samples per side; fold the 1/8 into the sample scale
+    // so the filter yields rise per world unit directly
+    float sampleScale = heightScale / 8.0f;
+
+    int threadCount = (int)std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::max(1, std::min(threadCount, height / kMinRowsPerThread));
+    if (threadCount == 1) {
+        bakeRows(heights, width, height, sampleScale, 0, height, packedNormals.data());
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    int rowsPerThread = (height + threadCount - 1) / threadCount;
+    for (int rowBegin = 0; rowBegin < height; rowBegin += rowsPerThread) {
+        int rowEnd = std::min(rowBegin + rowsPerThread, height);
+        workers.emplace_back(bakeRows, heights, width, height, sampleScale, rowBegin, rowEnd, packedNormals.data());
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void TerrainNormals::bakeRegion(const float *heights, int width, int height, float heightScale,
+                                int x0, int z0, int x1, int z1, GLuint *packedNormals) {
+    float sampleScale = heightScale / 8.0f;
+    auto sample = [&](int x, int z) {
+        x = std::min(std::max(x, 0), width - 1);
+        z = std::min(std::max(z, 0), height - 1);
+        return heights[(size_t)z * width + x] * sampleScale;
+    };
+    for (int z = std::max(z0, 0); z < std::min(z1, height); ++z) {
+        for (int x = std::max(x0, 0); x < std::min(x1, width); ++x) {
+            // Same sums in the same order as the scalar path of bakeRows
+            float gx = (sample(x + 1, z - 1) + 2.0f * sample(x + 1, z) + sample(x + 1, z + 1)) -
+                       (sample(x - 1, z - 1) + 2.0f * sample(x - 1, z) + sample(x - 1, z + 1));
+            float gz = (sample(x - 1, z + 1) + 2.0f * sample(x, z + 1) + sample(x + 1, z + 1)) -
+                       (sample(x - 1, z - 1) + 2.0f * sample(x, z - 1) + sample(x + 1, z - 1));
+            packedNormals[(size_t)z * width + x] = pack(glm::normalize(glm::vec3(-gx, 1.0f, -gz)));
+        }
+    }
+}
+
+void TerrainNormals::bakeRows(const float *heights, int width, int height, float sampleScale,
+                              int rowBegin, int rowEnd, GLuint *packedNormals) {
+    // Ring of the three float rows the filter reads; rows outside the map clamp to the edge
+    std::vector<float> ring(3 * (size_t)(width + 2));
+    float *rows[3] = {ring.data(), ring.data() + (width + 2), ring.data() + 2 * (width + 2)};
+    convertRow(heights + (size_t)std::max(rowBegin - 1, 0) * width, width, sampleScale, rows[0]);
+    convertRow(heights + (size_t)rowBegin * width, width, sampleScale, rows[1]);
+
+    for (int z = rowBegin; z < rowEnd; ++z) {
+        convertRow(heights + (size_t)std::min(z + 1, height - 1) * width, width, sampleScale, rows[2]);
+        // Padded rows: texel x sits at index x + 1
+        const float *up = rows[0], *mid = rows[1], *down = rows[2];
+        GLuint *out = packedNormals + (size_t)z * width;
+
+        int x = 0;
+#ifdef TERRAIN_NORMALS_SSE2
+        const __m128 two = _mm_set1_ps(2.0f);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 packScale = _mm_set1_ps(511.5f);
+        const __m128 packBias = _mm_set1_ps(512.0f); // Same rounding as pack()
+        const __m128 packMax = _mm_set1_ps(1023.0f);
+        const __m128 zero = _mm_setzero_ps();
+        for (; x + 4 <= width; x += 4) {
+            __m128 upL = _mm_loadu_ps(up + x), upC = _mm_loadu_ps(up + x + 1), upR = _mm_loadu_ps(up + x + 2);
+            __m128 midL = _mm_loadu_ps(mid + x), midR = _mm_loadu_ps(mid + x + 2);
+            __m128 downL = _mm_loadu_ps(down + x), downC = _mm_loadu_ps(down + x + 1), downR = _mm_loadu_ps(down + x + 2);
+
+            // Normal is (-dh/dx, 1, -dh/dz), normalized
+            __m128 gx = _mm_sub_ps(_mm_add_ps(_mm_add_ps(upR, downR), _mm_mul_ps(two, midR)),
+                                   _mm_add_ps(_mm_add_ps(upL, downL), _mm_mul_ps(two, midL)));
+            __m128 gz = _mm_sub_ps(_mm_add_ps(_mm_add_ps(downL, downR), _mm_mul_ps(two, downC)),
+                                   _mm_add_ps(_mm_add_ps(upL, upR), _mm_mul_ps(two, upC)));
+            __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(one, _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gz, gz)))));
+            __m128 nx = _mm_sub_ps(zero, _mm_mul_ps(gx, invLength));
+            __m128 nz = _mm_sub_ps(zero, _mm_mul_ps(gz, invLength));
+
+            __m128i px = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(nx, packScale), packBias), zero), packMax));
+            __m128i py = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(invLength, packScale), packBias), zero), packMax));
+            __m128i pz = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(nz, packScale), packBias), zero), packMax));
+            __m128i packed = _mm_or_si128(px, _mm_or_si128(_mm_slli_epi32(py, 10), _mm_slli_epi32(pz, 20)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), packed);
+        }
+#endif
+        for (; x < width; ++x) {
+            float gx = (up[x + 2] + 2.0f * mid[x + 2] + down[x + 2]) - (up[x] + 2.0f * mid[x] + down[x]);
+            float gz = (down[x] + 2.0f * down[x + 1] + down[x + 2]) - (up[x] + 2.0f * up[x + 1] + up[x + 2]);
+            out[x] = pack(glm::normalize(glm::vec3(-gx, 1.0f, -gz)));
+        }
+
+        std::rotate(rows, rows + 1, rows + 3); // Row z + 1 becomes the middle row
+    }
+}
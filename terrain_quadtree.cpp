@@ -0,0 +1,168 @@
+#include "lib/terrain_quadtree.h"
+#include "lib/terrain.h"
+#include <algorithm>
+#include <cfloat>
+
+TerrainQuadtree::TerrainQuadtree(const Terrain &terrain, int leafSize, float baseRange, float morphStartRatio)
+    : leafSize(leafSize) {
+    int gridWidth = terrain.getWidth();
+    int gridHeight = terrain.getHeight();
+    extentX = (float)(gridWidth - 1);
+    extentZ = (float)(gridHeight - 1);
+
+    // Leaves: scan the heightmap once for the min/max height of every leaf node
+    Level leaves;
+    leaves.nodesX = (gridWidth - 2) / leafSize + 1;
+    leaves.nodesZ = (gridHeight - 2) / leafSize + 1;
+    leaves.heightRange.assign(leaves.nodesX * leaves.nodesZ, glm::vec2(FLT_MAX, -FLT_MAX));
+    for (int z = 0; z < gridHeight; ++z) {
+        for (int x = 0; x < gridWidth; ++x) {
+            float height = terrain.getHeightAt((float)x, (float)z);
+            // A vertex on a node edge belongs to the nodes on both sides
+            int nodeX0 = std::max(0, (x - 1) / leafSize), nodeX1 = std::min(leaves.nodesX - 1, x / leafSize);
+            int nodeZ0 = std::max(0, (z - 1) / leafSize), nodeZ1 = std::min(leaves.nodesZ - 1, z / leafSize);
+            for (int nz = nodeZ0; nz <= nodeZ1; ++nz) {
+                for (int nx = nodeX0; nx <= nodeX1; ++nx) {
+                    glm::vec2 &range = leaves.heightRange[nz * leaves.nodesX + nx];
+                    range.x = std::min(range.x, height);
+                    range.y = std::max(range.y, height);
+                }
+            }
+        }
+    }
+    levels.push_back(leaves);
+
+    // Coarser levels merge 2x2 children until a single root covers the terrain
+    while ((levels.back().nodesX > 1 || levels.back().nodesZ > 1) && (int)levels.size() < CDLOD_MAX_LEVELS) {
+        const Level &child = levels.back();
+        Level parent;
+        parent.nodesX = (child.nodesX + 1) / 2;
+        parent.nodesZ = (child.nodesZ + 1) / 2;
+        parent.heightRange.assign(parent.nodesX * parent.nodesZ, glm::vec2(FLT_MAX, -FLT_MAX));
+        for (int z = 0; z < child.nodesZ; ++z) {
+            for (int x = 0; x < child.nodesX; ++x) {
+                glm::vec2 &range = parent.heightRange[(z / 2) * parent.nodesX + x / 2];
+                const glm::vec2 &childRange = child.heightRange[z * child.nodesX + x];
+                range.x = std::min(range.x, childRange.x);
+                range.y = std::max(range.y, childRange.y);
+            }
+        }
+        levels.push_back(parent);
+    }
+    levelCount = (int)levels.size();
+
+    // Every level sees twice as far as the one below it
+    float previousRange = 0.0f;
+    for (int level = 0; level < levelCount; ++level) {
+        float range = baseRange * (float)(1 << level);
+        lodRanges.push_back(range);
+        morphRanges.push_back(glm::vec2(previousRange + (range - previousRange) * morphStartRatio, range));
+        previousRange = range;
+    }
+}
+
+void TerrainQuadtree::updateHeights(const Terrain &terrain, int x0, int z0, int x1, int z1) {
+    if (x0 >= x1 || z0 >= z1) {
+        return;
+    }
+    int gridWidth = terrain.getWidth(), gridHeight = terrain.getHeight();
+
+    // Leaves touching the region are rescanned whole; edge vertices belong to both neighbours
+    Level &leaves = levels[0];
+    int nodeX0 = std::max(0, (x0 - 1) / leafSize), nodeX1 = std::min(leaves.nodesX - 1, (x1 - 1) / leafSize);
+    int nodeZ0 = std::max(0, (z0 - 1) / leafSize), nodeZ1 = std::min(leaves.nodesZ - 1, (z1 - 1) / leafSize);
+    for (int nz = nodeZ0; nz <= nodeZ1; ++nz) {
+        for (int nx = nodeX0; nx <= nodeX1; ++nx) {
+            glm::vec2 range(FLT_MAX, -FLT_MAX);
+            for (int z = nz * leafSize; z <= std::min((nz + 1) * leafSize, gridHeight - 1); ++z) {
+                for (int x = nx * leafSize; x <= std::min((nx + 1) * leafSize, gridWidth - 1); ++x) {
+                    float height = terrain.getHeightAt((float)x, (float)z);
+                    range.x = std::min(range.x, height);
+                    range.y = std::max(range.y, height);
+                }
+            }
+            leaves.heightRange[nz * leaves.nodesX + nx] = range;
+        }
+    }
+
+    // Then the ancestors of those leaves, from their children
+    for (int level = 1; level < levelCount; ++level) {
+        nodeX0 /= 2, nodeX1 /= 2, nodeZ0 /= 2, nodeZ1 /= 2;
+        const Level &child = levels[level - 1];
+        Level &parent = levels[level];
+        for (int nz = nodeZ0; nz <= nodeZ1; ++nz) {
+            for (int nx = nodeX0; nx <= nodeX1; ++nx) {
+                glm::vec2 range(FLT_MAX, -FLT_MAX);
+                for (int z = 2 * nz; z < std::min(2 * nz + 2, child.nodesZ); ++z) {
+                    for (int x = 2 * nx; x < std::min(2 * nx + 2, child.nodesX); ++x) {
+                        const glm::vec2 &childRange = child.heightRange[z * child.nodesX + x];
+                        range.x = std::min(range.x, childRange.x);
+                        range.y = std::max(range.y, childRange.y);
+                    }
+                }
+                parent.heightRange[nz * parent.nodesX + nx] = range;
+            }
+        }
+    }
+}
+
+void TerrainQuadtree::select(const glm::vec3 &cameraPosition, const Frustum &frustum, std::vector<SelectedNode> &selection) const {
+    selection.clear();
+    const Level &top = levels.back();
+    for (int z = 0; z < top.nodesZ; ++z) {
+        for (int x = 0; x < top.nodesX; ++x) {
+            selectNode(levelCount - 1, x, z, cameraPosition, frustum, selection);
+        }
+    }
+}
+
+// Returns false if the node is out of range for its level, leaving the parent to cover its area
+bool TerrainQuadtree::selectNode(int level, int nodeX, int nodeZ, const glm::vec3 &cameraPosition,
+                                 const Frustum &frustum, std::vector<SelectedNode> &selection) const {
+    glm::vec3 boxMin, boxMax;
+    getNodeBounds(level, nodeX, nodeZ, boxMin, boxMax);
+
+    if (!boxIntersectsSphere(boxMin, boxMax, cameraPosition, lodRanges[level])) {
+        return false;
+    }
+    if (!frustum.intersectsBox(boxMin, boxMax)) {
+        return true; // Handled: nothing of it is visible
+    }
+
+    float nodeSize = (float)(leafSize << level);
+    if (level == 0 || !boxIntersectsSphere(boxMin, boxMax, cameraPosition, lodRanges[level - 1])) {
+        selection.push_back({glm::vec2(nodeX * nodeSize, nodeZ * nodeSize), nodeSize, (float)level});
+        return true;
+    }
+
+    // Part of the node is close enough for the finer level; let the children decide
+    const Level &children = levels[level - 1];
+    for (int cz = nodeZ * 2; cz < std::min(nodeZ * 2 + 2, children.nodesZ); ++cz) {
+        for (int cx = nodeX * 2; cx < std::min(nodeX * 2 + 2, children.nodesX); ++cx) {
+            if (!selectNode(level - 1, cx, cz, cameraPosition, frustum, selection)) {
+                // Child is out of its range: draw its area at this node's LOD instead
+                glm::vec3 childMin, childMax;
+                getNodeBounds(level - 1, cx, cz, childMin, childMax);
+                if (frustum.intersectsBox(childMin, childMax)) {
+                    float childSize = nodeSize * 0.5f;
+                    selection.push_back({glm::vec2(cx * childSize, cz * childSize), childSize, (float)level});
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void TerrainQuadtree::getNodeBounds(int level, int nodeX, int nodeZ, glm::vec3 &boxMin, glm::vec3 &boxMax) const {
+    const Level &nodes = levels[level];
+    const glm::vec2 &range = nodes.heightRange[nodeZ * nodes.nodesX + nodeX];
+    float nodeSize = (float)(leafSize << level);
+    boxMin = glm::vec3(nodeX * nodeSize, range.x, nodeZ * nodeSize);
+    boxMax = glm::vec3(std::min((nodeX + 1) * nodeSize, extentX), range.y, std::min((nodeZ + 1) * nodeSize, extentZ));
+}
+
+bool TerrainQuadtree::boxIntersectsSphere(const glm::vec3 &boxMin, const glm::vec3 &boxMax, const glm::vec3 &center, float radius) {
+    glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+    glm::vec3 delta = closest - center;
+    return glm::dot(delta, delta) <= radius * radius;
+}
@@ -0,0 +1,479 @@
+#include "lib/terrain_streamer.h"
+#include "lib/mapped_file.h"
+#include "lib/terrain.h"
+#include "lib/terrain_normals.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+struct TerrainStreamer::Tile {
+    struct Chunk {
+        glm::vec3 minCorner; // World-space AABB
+        glm::vec3 maxCorner;
+        GLint baseVertex;
+    };
+
+    TileKey key;
+    bool loaded = false;
+    std::vector<float> heights;                   // (tileSize + 1)^2 samples, normalized, apron stripped
+    std::vector<GLuint> normals;                  // Packed like the heights
+    std::vector<Terrain::TerrainVertex> vertices; // Staging, released once uploaded
+    std::vector<Chunk> chunks;                    // Row-major
+    glm::vec3 minCorner, maxCorner;
+    GLuint vao = 0, vbo = 0, chunkOriginVBO = 0;
+    size_t bytes = 0; // CPU + GPU memory counted against the budget
+};
+
+TerrainStreamer::TerrainStreamer(const std::string &directory, float heightScale, const TerrainStreamSettings &settings)
+    : directory(directory), heightScale(heightScale), settings(settings) {
+    std::ifstream manifest(directory + "/" + TERRAIN_TILE_MANIFEST);
+    if (!(manifest >> tileSize >> tilesX >> tilesZ >> worldWidth >> worldHeight >> heightRange.x >> heightRange.y) ||
+        tileSize <= 0 || tileSize % TERRAIN_CHUNK_SIZE != 0) {
+        std::cerr << "Invalid terrain tile manifest in " << directory << std::endl;
+        return;
+    }
+
+    // Every chunk of every tile has the same size, so one set of strips serves them all
+    std::vector<GLushort> stripIndices;
+    Terrain::appendGridStrips(stripIndices, TERRAIN_CHUNK_SIZE, TERRAIN_CHUNK_SIZE);
+    chunkIndexCount = (GLsizei)stripIndices.size();
+    glGenBuffers(1, &chunkEBO);
+    glBindBuffer(GL_ARRAY_BUFFER, chunkEBO); // Bound to each tile's VAO as its element buffer later
+    glBufferData(GL_ARRAY_BUFFER, stripIndices.size() * sizeof(GLushort), stripIndices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glGenBuffers(1, &indirectBuffer);
+
+    valid = true;
+    for (int i = 0; i < std::max(1, settings.workerCount); ++i) {
+        workers.emplace_back(&TerrainStreamer::workerLoop, this);
+    }
+    std::cout << "Streaming terrain from " << directory << ": " << tilesX << "x" << tilesZ << " tiles of "
+              << tileSize << std::endl;
+}
+
+TerrainStreamer::~TerrainStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    for (auto &entry : residentTiles) {
+        releaseTile(*entry.second);
+    }
+    if (chunkEBO != 0) {
+        glDeleteBuffers(1, &chunkEBO);
+        glDeleteBuffers(1, &indirectBuffer);
+    }
+}
+
+bool TerrainStreamer::bakeTiles(const float *heights, int width, int height, int tileSize, const std::string &directory) {
+    if (tileSize <= 0 || tileSize % TERRAIN_CHUNK_SIZE != 0) {
+        std::cerr << "Tile size must be a multiple of " << TERRAIN_CHUNK_SIZE << std::endl;
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::cerr << "Failed to create tile directory: " << directory << std::endl;
+        return false;
+    }
+
+    // Tiles share their edge samples; the last row and column are padded out by clamping
+    int tilesX = (width - 2) / tileSize + 1;
+    int tilesZ = (height - 2) / tileSize + 1;
+    int side = tileSize + 1 + 2 * TERRAIN_TILE_APRON;
+    std::vector<GLushort> samples((size_t)side * side);
+    float minHeight = FLT_MAX, maxHeight = -FLT_MAX;
+
+    for (int tileZ = 0; tileZ < tilesZ; ++tileZ) {
+        for (int tileX = 0; tileX < tilesX; ++tileX) {
+            for (int z = 0; z < side; ++z) {
+                int sourceZ = glm::clamp(tileZ * tileSize + z - TERRAIN_TILE_APRON, 0, height - 1);
+                for (int x = 0; x < side; ++x) {
+                    int sourceX = glm::clamp(tileX * tileSize + x - TERRAIN_TILE_APRON, 0, width - 1);
+                    float sample = glm::clamp(heights[(size_t)sourceZ * width + sourceX], 0.0f, 1.0f);
+                    samples[(size_t)z * side + x] = (GLushort)(sample * 65535.0f + 0.5f);
+                    minHeight = std::min(minHeight, sample);
+                    maxHeight = std::max(maxHeight, sample);
+                }
+            }
+
+            std::string path = directory + "/tile_" + std::to_string(tileX) + "_" + std::to_string(tileZ) + ".r16";
+            std::ofstream out(path, std::ios::binary);
+            out.write(reinterpret_cast<const char *>(samples.data()), samples.size() * sizeof(GLushort));
+            if (!out) {
+                std::cerr << "Failed to write terrain tile: " << path << std::endl;
+                return false;
+            }
+        }
+    }
+
+    std::ofstream manifest(directory + "/" + TERRAIN_TILE_MANIFEST);
+    manifest << tileSize << ' ' << tilesX << ' ' << tilesZ << ' ' << width << ' ' << height << ' '
+             << minHeight << ' ' << maxHeight << '\n';
+    if (!manifest) {
+        std::cerr << "Failed to write terrain tile manifest in " << directory << std::endl;
+        return false;
+    }
+    std::cout << "Baked " << tilesX * tilesZ << " terrain tiles to " << directory << std::endl;
+    return true;
+}
+
+void TerrainStreamer::workerLoop() {
+    while (true) {
+        TileKey key;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping) {
+                return;
+            }
+            key = requests.front();
+            requests.pop_front();
+        }
+
+        std::unique_ptr<Tile> tile = loadTile(key); // Disk I/O and meshing, no lock held
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        completed.push_back(std::move(tile));
+    }
+}
+
+std::unique_ptr<TerrainStreamer::Tile> TerrainStreamer::loadTile(const TileKey &key) const {
+    std::unique_ptr<Tile> tile(new Tile());
+    tile->key = key;
+
+    int side = tileSize + 1 + 2 * TERRAIN_TILE_APRON;
+    MappedFile file;
+    if (!file.open(tilePath(key))) {
+        return tile;
+    }
+    if (file.size() != (size_t)side * side * sizeof(GLushort)) {
+        std::cerr << "Terrain tile has the wrong size: " << tilePath(key) << std::endl;
+        return tile;
+    }
+
+    // Normals are baked over the apron so they match the neighbouring tiles at the edges
+    std::vector<float> apronHeights((size_t)side * side);
+    const GLushort *samples = static_cast<const GLushort *>(file.data());
+    for (size_t i = 0; i < apronHeights.size(); ++i) {
+        apronHeights[i] = samples[i] / 65535.0f;
+    }
+    std::vector<GLuint> apronNormals;
+    TerrainNormals::bake(apronHeights.data(), side, side, heightScale, apronNormals);
+
+    int gridSide = tileSize + 1;
+    tile->heights.resize((size_t)gridSide * gridSide);
+    tile->normals.resize((size_t)gridSide * gridSide);
+    for (int z = 0; z < gridSide; ++z) {
+        size_t source = (size_t)(z + TERRAIN_TILE_APRON) * side + TERRAIN_TILE_APRON;
+        std::copy(apronHeights.begin() + source, apronHeights.begin() + source + gridSide, tile->heights.begin() + (size_t)z * gridSide);
+        std::copy(apronNormals.begin() + source, apronNormals.begin() + source + gridSide, tile->normals.begin() + (size_t)z * gridSide);
+    }
+
+    // Chunk meshes in the same packed layout as the Mesh render mode
+    float originX = (float)(key.first * tileSize), originZ = (float)(key.second * tileSize);
+    tile->minCorner = glm::vec3(originX, FLT_MAX, originZ);
+    tile->maxCorner = glm::vec3(originX + tileSize, -FLT_MAX, originZ + tileSize);
+    int chunksPerSide = tileSize / TERRAIN_CHUNK_SIZE;
+    for (int chunkZ = 0; chunkZ < chunksPerSide; ++chunkZ) {
+        for (int chunkX = 0; chunkX < chunksPerSide; ++chunkX) {
+            Tile::Chunk chunk;
+            chunk.baseVertex = (GLint)tile->vertices.size();
+            float minHeight = FLT_MAX, maxHeight = -FLT_MAX;
+            for (int z = 0; z <= TERRAIN_CHUNK_SIZE; ++z) {
+                for (int x = 0; x <= TERRAIN_CHUNK_SIZE; ++x) {
+                    size_t index = (size_t)(chunkZ * TERRAIN_CHUNK_SIZE + z) * gridSide + chunkX * TERRAIN_CHUNK_SIZE + x;
+                    float sample = tile->heights[index];
+                    Terrain::TerrainVertex vertex;
+                    vertex.x = (GLubyte)x;
+                    vertex.z = (GLubyte)z;
+                    vertex.height = (GLushort)(sample * 65535.0f + 0.5f);
+                    vertex.normal = tile->normals[index];
+                    tile->vertices.push_back(vertex);
+                    minHeight = std::min(minHeight, sample);
+                    maxHeight = std::max(maxHeight, sample);
+                }
+            }
+            chunk.minCorner = glm::vec3(originX + chunkX * TERRAIN_CHUNK_SIZE, minHeight * heightScale, originZ + chunkZ * TERRAIN_CHUNK_SIZE);
+            chunk.maxCorner = chunk.minCorner + glm::vec3((float)TERRAIN_CHUNK_SIZE, (maxHeight - minHeight) * heightScale, (float)TERRAIN_CHUNK_SIZE);
+            tile->minCorner.y = std::min(tile->minCorner.y, chunk.minCorner.y);
+            tile->maxCorner.y = std::max(tile->maxCorner.y, chunk.maxCorner.y);
+            tile->chunks.push_back(chunk);
+        }
+    }
+
+    tile->bytes = tile->heights.size() * sizeof(float) + tile->normals.size() * sizeof(GLuint) +
+                  tile->vertices.size() * sizeof(Terrain::TerrainVertex) + tile->chunks.size() * (sizeof(Tile::Chunk) + sizeof(glm::vec2));
+    tile->loaded = true;
+    return tile;
+}
+
+void TerrainStreamer::uploadTile(Tile &tile) {
+    std::vector<glm::vec2> chunkOrigins;
+    for (const auto &chunk : tile.chunks) {
+        chunkOrigins.push_back(glm::vec2(chunk.minCorner.x, chunk.minCorner.z));
+    }
+
+    glGenVertexArrays(1, &tile.vao);
+    glGenBuffers(1, &tile.vbo);
+    glGenBuffers(1, &tile.chunkOriginVBO);
+    glBindVertexArray(tile.vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, tile.vbo);
+    glBufferData(GL_ARRAY_BUFFER, tile.vertices.size() * sizeof(Terrain::TerrainVertex), tile.vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, tile.chunkOriginVBO);
+    glBufferData(GL_ARRAY_BUFFER, chunkOrigins.size() * sizeof(glm::vec2), chunkOrigins.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunkEBO);
+    Terrain::setupPackedVertexLayout(tile.vbo, tile.chunkOriginVBO);
+
+    glBindVertexArray(0);
+    std::vector<Terrain::TerrainVertex>().swap(tile.vertices); // Heights and normals stay for queries
+}
+
+void TerrainStreamer::releaseTile(Tile &tile) {
+    if (tile.vao != 0) {
+        glDeleteBuffers(1, &tile.vbo);
+        glDeleteBuffers(1, &tile.chunkOriginVBO);
+        glDeleteVertexArrays(1, &tile.vao);
+        tile.vao = tile.vbo = tile.chunkOriginVBO = 0;
+    }
+}
+
+void TerrainStreamer::update(const glm::vec3 &focus) {
+    if (!valid) {
+        return;
+    }
+    TileKey currentTile = tileAt(focus.x, focus.z);
+    if (currentTile != focusTile) {
+        focusTile = currentTile;
+        requestTiles(focusTile);
+    }
+
+    // Hand a few finished tiles to the GPU; the rest wait for the next frame
+    std::vector<std::unique_ptr<Tile>> ready;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        while (!completed.empty() && (int)ready.size() < settings.uploadsPerFrame) {
+            ready.push_back(std::move(completed.front()));
+            completed.pop_front();
+        }
+    }
+    for (auto &tile : ready) {
+        inFlight.erase(tile->key);
+        if (!tile->loaded) {
+            if (++failedTiles[tile->key] >= TERRAIN_TILE_LOAD_ATTEMPTS) {
+                std::cerr << "Giving up on terrain tile: " << tilePath(tile->key) << std::endl;
+            } else {
+                nextRetry = std::chrono::steady_clock::now() + std::chrono::milliseconds(TERRAIN_TILE_RETRY_MS);
+            }
+            continue;
+        }
+        failedTiles.erase(tile->key);
+        if (!isInLoadRadius(tile->key, focusTile) || residentTiles.count(tile->key)) {
+            continue; // The focus moved on while it was loading
+        }
+        uploadTile(*tile);
+        residentBytes += tile->bytes;
+        residentTiles[tile->key] = std::move(tile);
+    }
+    retryFailedTiles();
+
+    // Over budget: drop the farthest tiles outside the load radius
+    while (residentBytes > settings.memoryBudget) {
+        auto farthest = residentTiles.end();
+        int farthestDistance = -1;
+        for (auto it = residentTiles.begin(); it != residentTiles.end(); ++it) {
+            if (isInLoadRadius(it->first, focusTile)) {
+                continue;
+            }
+            int distance = std::max(std::abs(it->first.first - focusTile.first), std::abs(it->first.second - focusTile.second));
+            if (distance > farthestDistance) {
+                farthestDistance = distance;
+                farthest = it;
+            }
+        }
+        if (farthest == residentTiles.end()) {
+            if (!budgetWarningShown) {
+                std::cerr << "Terrain tile budget is too small for the load radius" << std::endl;
+                budgetWarningShown = true;
+            }
+            break;
+        }
+        residentBytes -= farthest->second->bytes;
+        releaseTile(*farthest->second);
+        residentTiles.erase(farthest);
+    }
+}
+
+void TerrainStreamer::waitForTiles(const glm::vec3 &focus) {
+    if (!valid) {
+        return;
+    }
+    focusTile = TileKey(-1, -1); // Forces a fresh request round
+    update(focus);
+    while (!inFlight.empty()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        update(focus);
+    }
+}
+
+void TerrainStreamer::requestTiles(const TileKey &focusTile) {
+    std::vector<TileKey> wanted;
+    int radius = settings.loadRadius;
+    for (int z = std::max(0, focusTile.second - radius); z <= std::min(tilesZ - 1, focusTile.second + radius); ++z) {
+        for (int x = std::max(0, focusTile.first - radius); x <= std::min(tilesX - 1, focusTile.first + radius); ++x) {
+            auto failed = failedTiles.find(TileKey(x, z));
+            bool givenUp = failed != failedTiles.end() && failed->second >= TERRAIN_TILE_LOAD_ATTEMPTS;
+            if (!residentTiles.count(TileKey(x, z)) && !givenUp) {
+                wanted.push_back(TileKey(x, z));
+            }
+        }
+    }
+    std::sort(wanted.begin(), wanted.end(), [&focusTile](const TileKey &a, const TileKey &b) {
+        int ax = a.first - focusTile.first, az = a.second - focusTile.second;
+        int bx = b.first - focusTile.first, bz = b.second - focusTile.second;
+        return ax * ax + az * az < bx * bx + bz * bz;
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        // Requeue by the new distances. Tiles already on a worker finish and are dropped on arrival if unwanted.
+        for (const auto &key : requests) {
+            inFlight.erase(key);
+        }
+        requests.clear();
+        for (const auto &key : wanted) {
+            if (inFlight.insert(key).second) {
+                requests.push_back(key);
+            }
+        }
+    }
+    queueCondition.notify_all();
+}
+
+void TerrainStreamer::retryFailedTiles() {
+    if (failedTiles.empty() || std::chrono::steady_clock::now() < nextRetry) {
+        return;
+    }
+    nextRetry = std::chrono::steady_clock::now() + std::chrono::milliseconds(TERRAIN_TILE_RETRY_MS);
+
+    // Tiles that failed to load (still being written, a transient I/O error) go to the back
+    // of the queue. Given-up tiles stay in the map so they are not requested again.
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (const auto &entry : failedTiles) {
+            const TileKey &key = entry.first;
+            if (entry.second < TERRAIN_TILE_LOAD_ATTEMPTS && isInLoadRadius(key, focusTile) && !residentTiles.count(key) &&
+                inFlight.insert(key).second) {
+                requests.push_back(key);
+                queued = true;
+            }
+        }
+    }
+    if (queued) {
+        queueCondition.notify_all();
+    }
+}
+
+bool TerrainStreamer::isInLoadRadius(const TileKey &key, const TileKey &focusTile) const {
+    return std::abs(key.first - focusTile.first) <= settings.loadRadius && std::abs(key.second - focusTile.second) <= settings.loadRadius;
+}
+
+void TerrainStreamer::render(Shader &shader, const Frustum &frustum) {
+    shader.setFloat("terrainScale", heightScale);
+    // The world's grid size, as in Terrain::render, so the texture repeats at the same scale
+    shader.setVec2("terrainExtent", glm::vec2((float)(worldWidth - 1), (float)(worldHeight - 1)));
+
+    std::vector<Terrain::DrawElementsIndirectCommand> drawCommands;
+    glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    for (const auto &entry : residentTiles) {
+        const Tile &tile = *entry.second;
+        if (!frustum.intersectsBox(tile.minCorner, tile.maxCorner)) {
+            continue;
+        }
+        drawCommands.clear();
+        for (GLuint i = 0; i < tile.chunks.size(); ++i) {
+            if (frustum.intersectsBox(tile.chunks[i].minCorner, tile.chunks[i].maxCorner)) {
+                drawCommands.push_back({(GLuint)chunkIndexCount, 1, 0, tile.chunks[i].baseVertex, i});
+            }
+        }
+        if (drawCommands.empty()) {
+            continue;
+        }
+        glBindVertexArray(tile.vao);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCommands.size() * sizeof(Terrain::DrawElementsIndirectCommand), drawCommands.data(), GL_STREAM_DRAW);
+        glMultiDrawElementsIndirect(GL_TRIANGLE_STRIP, GL_UNSIGNED_SHORT, 0, (GLsizei)drawCommands.size(), 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    glBindVertexArray(0);
+}
+
+TerrainStreamer::TileKey TerrainStreamer::tileAt(float x, float z) const {
+    int tileX = glm::clamp((int)std::floor(x / tileSize), 0, tilesX - 1);
+    int tileZ = glm::clamp((int)std::floor(z / tileSize), 0, tilesZ - 1);
+    return TileKey(tileX, tileZ);
+}
+
+const TerrainStreamer::Tile *TerrainStreamer::residentTileAt(float x, float z, float &localX, float &localZ) const {
+    if (!valid) {
+        return nullptr;
+    }
+    TileKey key = tileAt(x, z);
+    auto it = residentTiles.find(key);
+    if (it == residentTiles.end()) {
+        return nullptr;
+    }
+    localX = glm::clamp(x - (float)(key.first * tileSize), 0.0f, (float)tileSize);
+    localZ = glm::clamp(z - (float)(key.second * tileSize), 0.0f, (float)tileSize);
+    return it->second.get();
+}
+
+bool TerrainStreamer::getHeightAt(float x, float z, float &height) const {
+    float localX, localZ;
+    const Tile *tile = residentTileAt(x, z, localX, localZ);
+    if (!tile) {
+        return false;
+    }
+    int gridSide = tileSize + 1;
+    int x0 = std::min((int)localX, tileSize - 1), z0 = std::min((int)localZ, tileSize - 1);
+    float tx = localX - x0, tz = localZ - z0;
+    const float *row0 = &tile->heights[(size_t)z0 * gridSide + x0];
+    const float *row1 = row0 + gridSide;
+    float h0 = row0[0] + (row0[1] - row0[0]) * tx;
+    float h1 = row1[0] + (row1[1] - row1[0]) * tx;
+    height = (h0 + (h1 - h0) * tz) * heightScale;
+    return true;
+}
+
+bool TerrainStreamer::getNormalAt(float x, float z, glm::vec3 &normal) const {
+    float localX, localZ;
+    const Tile *tile = residentTileAt(x, z, localX, localZ);
+    if (!tile) {
+        return false;
+    }
+    int gridSide = tileSize + 1;
+    int x0 = std::min((int)localX, tileSize - 1), z0 = std::min((int)localZ, tileSize - 1);
+    float tx = localX - x0, tz = localZ - z0;
+    const GLuint *row0 = &tile->normals[(size_t)z0 * gridSide + x0];
+    const GLuint *row1 = row0 + gridSide;
+    glm::vec3 n0 = glm::mix(TerrainNormals::unpack(row0[0]), TerrainNormals::unpack(row0[1]), tx);
+    glm::vec3 n1 = glm::mix(TerrainNormals::unpack(row1[0]), TerrainNormals::unpack(row1[1]), tx);
+    normal = glm::normalize(glm::mix(n0, n1, tz));
+    return true;
+}
+
+std::string TerrainStreamer::tilePath(const TileKey &key) const {
+    return directory + "/tile_" + std::to_string(key.first) + "_" + std::to_string(key.second) + ".r16";
+}